@@ -0,0 +1,119 @@
+/* Hides the flicker of sprites erased and drawn again with XOR */
+
+#include "AntiFlicker.hpp"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* out = every screen ORed together, without the pixels of 'lit' if
+ * it's given */
+static void orScreens(uint64_t out[32], const uint64_t (*screens)[32],
+    int count, const uint64_t *lit)
+{
+#ifdef __SSE2__
+    for(int y=0; y<32; y+=2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)&screens[0][y]);
+        for(int i=1; i<count; i++)
+            v = _mm_or_si128(v, _mm_loadu_si128((const __m128i*)&screens[i][y]));
+        if(lit) v = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)&lit[y]), v);
+        _mm_storeu_si128((__m128i*)&out[y], v);
+    }
+#else
+    for(int y=0; y<32; y++)
+    {
+        uint64_t v = screens[0][y];
+        for(int i=1; i<count; i++) v |= screens[i][y];
+        out[y] = lit ? v & ~lit[y] : v;
+    }
+#endif
+}
+
+/* Constructor */
+AntiFlicker::AntiFlicker(void)
+{
+    m_Mode = FLICKER_NONE;
+    m_Frames = 1;
+    m_Settle = false;
+
+    memset(m_Ring, 0, sizeof(m_Ring));
+    m_Pos = 0;
+
+    memset(m_Settled, 0, sizeof(m_Settled));
+    m_Unsettled = false;
+    m_Held = 0;
+
+    memset(m_Out, 0, sizeof(m_Out));
+    memset(m_Last, 0, sizeof(m_Last));
+}
+
+/* Pick how frames are blended */
+void AntiFlicker::SetMode(FlickerMode mode, int frames)
+{
+    m_Mode = mode;
+    m_Frames = frames < 1 ? 1 : frames > FLICKER_MAX_FRAMES ?
+        FLICKER_MAX_FRAMES : frames;
+
+    memset(m_Ring, 0, sizeof(m_Ring));
+    m_Pos = 0;
+}
+
+/* Note what the last screen instruction did */
+void AntiFlicker::Drawn(Chip8 &chip, WORD pc)
+{
+    // the PC can be on the last byte of memory
+    WORD op = pc + 1 < (int)sizeof(chip.m_GameMemory) ?
+        (chip.m_GameMemory[pc] << 8) | chip.m_GameMemory[pc+1] : 0;
+
+    // DXYN sets VF when it turned pixels off
+    m_Unsettled = op == 0x00E0 || chip.m_Registers[0xF] != 0;
+}
+
+/* Work out what to show */
+bool AntiFlicker::Present(const uint64_t screen[32], const uint64_t **plane0,
+    const uint64_t **plane1)
+{
+    // a half drawn frame shows the last whole one for a while
+    const uint64_t *src = screen;
+    if(m_Settle)
+    {
+        if(m_Unsettled && m_Held < FLICKER_MAX_HOLD)
+        {
+            src = m_Settled;
+            m_Held++;
+        }
+        else
+        {
+            memcpy(m_Settled, screen, sizeof(m_Settled));
+            m_Held = 0;
+        }
+
+        // the next frame is only half drawn if Drawn() says so; one that
+        // doesn't draw at all isn't
+        m_Unsettled = false;
+    }
+
+    if(m_Mode == FLICKER_NONE) memcpy(m_Out[0], src, sizeof(m_Out[0]));
+    else
+    {
+        memcpy(m_Ring[m_Pos], src, sizeof(m_Ring[0]));
+        m_Pos = (m_Pos + 1) % m_Frames;
+
+        if(m_Mode == FLICKER_OR) orScreens(m_Out[0], m_Ring, m_Frames, NULL);
+        else
+        {
+            memcpy(m_Out[0], src, sizeof(m_Out[0]));
+            orScreens(m_Out[1], m_Ring, m_Frames, src);
+        }
+    }
+
+    *plane0 = m_Out[0];
+    *plane1 = m_Mode == FLICKER_FADE ? m_Out[1] : NULL;
+
+    bool changed = memcmp(m_Out, m_Last, sizeof(m_Out)) != 0;
+    if(changed) memcpy(m_Last, m_Out, sizeof(m_Last));
+    return changed;
+}
@@ -0,0 +1,74 @@
+/* Hides the flicker of sprites erased and drawn again with XOR */
+
+#include <stdint.h>
+
+#include "Chip8.hpp"
+
+#ifndef ANTIFLICKER_H_INCLUDED
+#define ANTIFLICKER_H_INCLUDED
+
+// most frames that can be blended
+#define FLICKER_MAX_FRAMES 8
+
+// most frames in a row the last settled screen is shown instead
+#define FLICKER_MAX_HOLD 3
+
+enum FlickerMode
+{
+    FLICKER_NONE,
+    FLICKER_OR,     // pixels stay lit for the last N frames
+    FLICKER_FADE    // pixels lit in the last N frames but not now are
+                    // shown in the palette's plane 1 color
+};
+
+// Sits between the machine and the display. The last N screens are
+// kept in a ring and ORed together a whole row (or two, with SSE2) at
+// a time, which is a couple of hundred nanoseconds a frame.
+//
+// With settling on, a frame whose last screen instruction erased
+// something (00E0, or DXYN turning pixels off) is taken as half drawn:
+// the game is about to draw again. The last screen that didn't end
+// that way is shown instead, for up to FLICKER_MAX_HOLD frames.
+class AntiFlicker
+{
+public:
+    // constructor
+    AntiFlicker(void);
+
+    // blend 'frames' frames (1 to FLICKER_MAX_FRAMES)
+    void SetMode(FlickerMode mode, int frames);
+    void SetSettle(bool settle){m_Settle = settle;}
+
+    // false if the screen goes to the display untouched
+    bool Enabled(void){return m_Mode != FLICKER_NONE || m_Settle;}
+
+    // the instruction at 'pc' just changed the screen (from a
+    // CHIP8_EVENT_SCREEN)
+    void Drawn(Chip8 &chip, WORD pc);
+
+    // once a frame: what to show for 'screen'. 'plane1' is the second
+    // bitplane for Scaler::Scale(), or NULL. true if it's different
+    // from last time
+    bool Present(const uint64_t screen[32], const uint64_t **plane0,
+        const uint64_t **plane1);
+
+private:
+    FlickerMode m_Mode;
+    int m_Frames;
+    bool m_Settle;
+
+    // the last m_Frames screens, m_Pos is the oldest
+    uint64_t m_Ring[FLICKER_MAX_FRAMES][32];
+    int m_Pos;
+
+    // the last screen that wasn't half drawn
+    uint64_t m_Settled[32];
+    bool m_Unsettled;
+    int m_Held;
+
+    // what Present() gave out, and last time's to compare with
+    uint64_t m_Out[2][32];
+    uint64_t m_Last[2][32];
+};
+
+#endif // ANTIFLICKER_H_INCLUDED
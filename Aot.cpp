@@ -0,0 +1,102 @@
+/* Runs ROM code compiled ahead of time by chip8aot */
+
+#include "Aot.hpp"
+#include "Chip8.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+/* Constructor */
+AotModule::AotModule(void)
+{
+    m_Handle = NULL;
+    m_Info = NULL;
+    memset(m_Blocks, 0, sizeof(m_Blocks));
+    memset(m_Entry, 0, sizeof(m_Entry));
+    m_MaxBytes = 0;
+}
+
+/* Deconstructor */
+AotModule::~AotModule(void)
+{
+    if(!m_Handle) return;
+#ifdef __WIN32
+    FreeLibrary((HMODULE)m_Handle);
+#else
+    dlclose(m_Handle);
+#endif
+}
+
+/* Load a module */
+bool AotModule::Open(const char *fname)
+{
+#ifdef __WIN32
+    m_Handle = (void*)LoadLibraryA(fname);
+    if(m_Handle)
+        m_Info = (const AotInfo*)GetProcAddress((HMODULE)m_Handle, CHIP8_AOT_SYMBOL);
+#else
+    m_Handle = dlopen(fname, RTLD_NOW | RTLD_LOCAL);
+    if(!m_Handle)
+        fprintf(stderr, "AotModule::Open: %s\n", dlerror());
+    else
+        m_Info = (const AotInfo*)dlsym(m_Handle, CHIP8_AOT_SYMBOL);
+#endif
+    if(!m_Info)
+    {
+        fprintf(stderr, "AotModule::Open: '%s' isn't a chip8aot module\n", fname);
+        return false;
+    }
+
+    if(m_Info->abi != CHIP8_AOT_ABI || m_Info->chipSize != sizeof(Chip8))
+    {
+        fprintf(stderr, "AotModule::Open: '%s' was built for another version "
+            "of the emulator, run chip8aot again\n", fname);
+        m_Info = NULL;
+        return false;
+    }
+
+    for(uint32_t i=0; i<m_Info->blockCount; i++)
+    {
+        const AotBlock &b = m_Info->blocks[i];
+        if(b.start < 0x200 || b.start + b.count*2 > 0x200 + (int)m_Info->romSize)
+            continue;
+
+        m_Blocks[b.start] = &b;
+        if(b.count*2 > m_MaxBytes) m_MaxBytes = b.count*2;
+    }
+
+    return true;
+}
+
+/* Turn blocks on or off to match memory */
+void AotModule::Check(const uint8_t *memory, int start, int end)
+{
+    // any block starting this far back can reach 'start'
+    int first = start - m_MaxBytes + 1;
+    if(first < 0x200) first = 0x200;
+    if(end > 0xFFF) end = 0xFFF;
+
+    for(int a=first; a<end; a++)
+    {
+        const AotBlock *b = m_Blocks[a];
+        if(!b || a + b->count*2 <= start) continue;
+
+        bool same = memcmp(memory + a, m_Info->rom + (a - 0x200), b->count*2) == 0;
+        m_Entry[a] = same ? b : NULL;
+    }
+}
+
+/* Count the blocks in use */
+int AotModule::Enabled(void)
+{
+    int n = 0;
+    for(int a=0; a<0x1000; a++)
+        if(m_Entry[a]) n++;
+    return n;
+}
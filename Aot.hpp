@@ -0,0 +1,76 @@
+/* Runs ROM code compiled ahead of time by chip8aot */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef AOT_H_INCLUDED
+#define AOT_H_INCLUDED
+
+class Chip8;
+
+// bumped whenever AotInfo/AotBlock or what blocks may assume changes
+#define CHIP8_AOT_ABI 1
+
+// what a module exports
+#define CHIP8_AOT_SYMBOL "chip8_aot_info"
+
+// a basic block: 'count' instructions from 'start' that run straight
+// through. run() does what the interpreter would for all of them,
+// including adding them to m_Cycles and setting m_PC to what's next
+struct AotBlock
+{
+    uint16_t start;
+    uint16_t count;
+    void (*run)(Chip8 &c);
+};
+
+// the module's description of itself
+struct AotInfo
+{
+    uint32_t abi;           // CHIP8_AOT_ABI
+    uint32_t chipSize;      // sizeof(Chip8) it was compiled against
+    const char *quirks;     // the profile its semantics are for
+    const uint8_t *rom;     // the ROM it was compiled from (at 0x200)
+    uint32_t romSize;
+    const AotBlock *blocks;
+    uint32_t blockCount;
+};
+
+// A loaded module. Blocks are only handed out while the memory they
+// were compiled from still holds the same bytes: Check() is called for
+// every write that can land on code (loads, FX33/FX55, snapshots), and
+// turns blocks back on once their bytes match again.
+class AotModule
+{
+public:
+    // constructor/deconstructor
+    AotModule(void);
+    ~AotModule(void);
+
+    // dlopen 'fname' and check it was built for this emulator. blocks
+    // start out off until Check() sees their code in memory
+    bool Open(const char *fname);
+
+    // the quirk profile the module needs
+    const char *Quirks(void){return m_Info->quirks;}
+
+    // the block starting at 'pc' if it matches memory, or NULL
+    const AotBlock *Find(uint16_t pc){return pc < 0x1000 ? m_Entry[pc] : NULL;}
+
+    // memory from 'start' up to 'end' changed: recheck the blocks on it
+    void Check(const uint8_t *memory, int start, int end);
+
+    // blocks that match memory right now
+    int Enabled(void);
+    int Blocks(void){return m_Info->blockCount;}
+
+private:
+    void *m_Handle;
+    const AotInfo *m_Info;
+
+    const AotBlock *m_Blocks[0x1000];   // every block, by start
+    const AotBlock *m_Entry[0x1000];    // the ones in use
+    int m_MaxBytes;                     // longest block
+};
+
+#endif // AOT_H_INCLUDED
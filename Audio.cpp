@@ -0,0 +1,232 @@
+/* How to make sound */
+
+#include "Audio.hpp"
+
+#include <string.h>
+
+#include <chrono>
+
+static const int TONE_HZ    = 440;
+static const int AMPLITUDE  = 4000;
+
+/* Constructor */
+Audio::Audio(void)
+{
+    m_Produced = 0;
+    m_Running = false;
+
+    m_PlayPos = 0;
+    m_ToneOn = false;
+    m_Phase = 0;
+
+    m_SampleRate = 44100;
+    // 512 samples is ~11.6ms, so the output is always less than one
+    // 60hz frame behind the emulation
+    m_BufferSamples = 512;
+
+    m_SDLOpen = false;
+    m_WavFile = NULL;
+    m_WavSamples = 0;
+}
+
+/* Deconstructor */
+Audio::~Audio(void)
+{
+    close();
+}
+
+/* Open the sound card */
+bool Audio::openSDL(void)
+{
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+    {
+        fprintf(stderr, "Audio::openSDL: Failed to init SDL audio: %s\n",
+            SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec want, have;
+    memset(&want, 0, sizeof(want));
+    want.freq     = m_SampleRate;
+    want.format   = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples  = m_BufferSamples;
+    want.callback = sdlCallback;
+    want.userdata = this;
+
+    if(SDL_OpenAudio(&want, &have) != 0)
+    {
+        fprintf(stderr, "Audio::openSDL: Failed to open audio: %s\n",
+            SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+
+    m_SampleRate    = have.freq;
+    m_BufferSamples = have.samples;
+    m_SDLOpen = true;
+
+    SDL_PauseAudio(0);
+
+    return true;
+}
+
+/* write a little endian value */
+static void writeLE(FILE *fp, uint32_t value, int bytes)
+{
+    for(int i=0; i<bytes; i++)
+        fputc((value >> (i*8)) & 0xFF, fp);
+}
+
+/* write the 44 byte .wav header */
+static void writeWAVHeader(FILE *fp, int rate, uint32_t samples)
+{
+    uint32_t dataBytes = samples * 2;
+
+    fwrite("RIFF", 4, 1, fp);
+    writeLE(fp, 36 + dataBytes, 4);
+    fwrite("WAVE", 4, 1, fp);
+
+    fwrite("fmt ", 4, 1, fp);
+    writeLE(fp, 16, 4);       // chunk size
+    writeLE(fp, 1, 2);        // PCM
+    writeLE(fp, 1, 2);        // mono
+    writeLE(fp, rate, 4);
+    writeLE(fp, rate * 2, 4); // bytes per second
+    writeLE(fp, 2, 2);        // block align
+    writeLE(fp, 16, 2);       // bits per sample
+
+    fwrite("data", 4, 1, fp);
+    writeLE(fp, dataBytes, 4);
+}
+
+/* Dump the output to a file */
+bool Audio::openWAV(const char *fname)
+{
+    m_WavFile = fopen(fname, "wb");
+    if(!m_WavFile)
+    {
+        fprintf(stderr, "Audio::openWAV: Failed to open '%s'\n", fname);
+        return false;
+    }
+
+    // sizes are fixed up in close()
+    writeWAVHeader(m_WavFile, m_SampleRate, 0);
+
+    m_Running = true;
+    m_WavThread = std::thread(&Audio::wavThread, this);
+
+    return true;
+}
+
+/* Stop output */
+void Audio::close(void)
+{
+    if(m_SDLOpen)
+    {
+        SDL_CloseAudio();
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        m_SDLOpen = false;
+    }
+
+    if(m_WavFile)
+    {
+        m_Running = false;
+        if(m_WavThread.joinable()) m_WavThread.join();
+
+        fseek(m_WavFile, 0, SEEK_SET);
+        writeWAVHeader(m_WavFile, m_SampleRate, m_WavSamples);
+        fclose(m_WavFile);
+        m_WavFile = NULL;
+    }
+}
+
+/* The tone starts or stops */
+void Audio::setTone(bool on, uint64_t sample)
+{
+    AudioEvent e;
+    e.sample = sample;
+    e.on = on;
+
+    // if the consumer is stuck the event is lost, but the emulation
+    // keeps going
+    m_Events.push(e);
+}
+
+/* Everything up to here has been produced */
+void Audio::sync(uint64_t sample)
+{
+    m_Produced.store(sample, std::memory_order_release);
+}
+
+/* Synthesize samples from the queued events */
+void Audio::mix(Sint16 *out, int count)
+{
+    int period = m_SampleRate / TONE_HZ;
+
+    for(int i=0; i<count; i++, m_PlayPos++)
+    {
+        // apply every event that is due at this sample
+        AudioEvent e;
+        while(m_Events.peek(e) && e.sample <= m_PlayPos)
+        {
+            m_Events.pop(e);
+            m_ToneOn = e.on;
+        }
+
+        if(m_ToneOn)
+        {
+            out[i] = (m_Phase < period/2) ? AMPLITUDE : -AMPLITUDE;
+            if(++m_Phase >= period) m_Phase = 0;
+        }
+        else
+        {
+            out[i] = 0;
+            m_Phase = 0;
+        }
+    }
+}
+
+/* SDL wants more samples */
+void Audio::sdlCallback(void *userdata, Uint8 *stream, int len)
+{
+    Audio *a = (Audio*)userdata;
+    int count = len / 2;
+
+    // play one buffer behind what the emulation has produced. if the
+    // two clocks drifted more than a frame apart, snap back so the
+    // latency stays under a frame
+    uint64_t produced = a->m_Produced.load(std::memory_order_acquire);
+    uint64_t target = produced > (uint64_t)count ? produced - count : 0;
+    uint64_t frame = a->m_SampleRate / 60;
+    if(a->m_PlayPos + frame < target || a->m_PlayPos > target + frame)
+        a->m_PlayPos = target;
+
+    a->mix((Sint16*)stream, count);
+}
+
+/* Write everything produced so far into the .wav file */
+void Audio::wavThread(void)
+{
+    Sint16 buf[1024];
+
+    for(;;)
+    {
+        bool running = m_Running;
+
+        uint64_t produced = m_Produced.load(std::memory_order_acquire);
+        while(m_PlayPos < produced)
+        {
+            uint64_t left = produced - m_PlayPos;
+            int count = left < 1024 ? (int)left : 1024;
+
+            mix(buf, count);
+            fwrite(buf, 2, count, m_WavFile);
+            m_WavSamples += count;
+        }
+
+        if(!running) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
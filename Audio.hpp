@@ -0,0 +1,80 @@
+/* How to make sound */
+
+// uses SDL 1.2
+#include <SDL/SDL.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "RingBuffer.hpp"
+
+#ifndef AUDIO_H_INCLUDED
+#define AUDIO_H_INCLUDED
+
+// a change of the sound timer state at an exact sample on the
+// emulated timeline
+struct AudioEvent
+{
+    uint64_t sample;
+    bool     on;
+};
+
+class Audio
+{
+public:
+    // constructor/deconstructor
+    Audio(void);
+    ~Audio(void);
+
+    // play through the sound card with an SDL callback
+    bool openSDL(void);
+
+    // write the output to a .wav file instead (for headless runs)
+    bool openWAV(const char *fname);
+
+    // stop output and finish the .wav file if there is one
+    void close(void);
+
+    // output samples per second
+    int sampleRate(void){return m_SampleRate;}
+
+    // (emulation thread) the tone starts or stops at 'sample'.
+    // never blocks
+    void setTone(bool on, uint64_t sample);
+
+    // (emulation thread) everything up to 'sample' has been
+    // produced; called once per frame
+    void sync(uint64_t sample);
+
+private:
+    // fill 'count' samples starting at m_PlayPos
+    void mix(Sint16 *out, int count);
+
+    static void sdlCallback(void *userdata, Uint8 *stream, int len);
+
+    // drains the ring into the .wav file
+    void wavThread(void);
+
+    RingBuffer<AudioEvent, 1024> m_Events;
+
+    std::atomic<uint64_t> m_Produced; // last position given to sync()
+    std::atomic<bool>     m_Running;
+
+    // consumer state
+    uint64_t m_PlayPos;   // sample position on the emulated timeline
+    bool     m_ToneOn;
+    int      m_Phase;
+
+    int m_SampleRate;
+    int m_BufferSamples;  // samples per SDL callback
+
+    bool         m_SDLOpen;
+    FILE        *m_WavFile;
+    uint32_t     m_WavSamples;
+    std::thread  m_WavThread;
+};
+
+#endif // AUDIO_H_INCLUDED
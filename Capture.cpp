@@ -0,0 +1,338 @@
+/* Records the screen to a .y4m or .gif video */
+
+#include "Capture.hpp"
+
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+/* Constructor */
+VideoRecorder::VideoRecorder(void)
+{
+    m_Running = false;
+    m_File = NULL;
+    m_GIF = false;
+    m_Scale = 1;
+    m_Dropped = 0;
+
+    m_HavePending = false;
+    m_PendingFrames = 0;
+    m_FramesWritten = 0;
+    m_CentisWritten = 0;
+}
+
+/* Deconstructor */
+VideoRecorder::~VideoRecorder(void)
+{
+    Close();
+}
+
+/* Start recording */
+bool VideoRecorder::Open(const char *fname, int scale)
+{
+    m_File = fopen(fname, "wb");
+    if(!m_File)
+    {
+        fprintf(stderr, "VideoRecorder::Open: Failed to open '%s'\n", fname);
+        return false;
+    }
+
+    size_t len = strlen(fname);
+    m_GIF = len > 4 && strcmp(fname + len - 4, ".gif") == 0;
+    m_Scale = scale < 1 ? 1 : scale;
+
+    if(m_GIF)
+    {
+        WriteGIFHeader();
+    }
+    else
+    {
+        // 4:2:0 with full range luma, so lit pixels are exactly black.
+        // C420jpeg is only the chroma siting, the range has to be said
+        // separately or players take 0 and 255 as studio range
+        fprintf(m_File, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+            64 * m_Scale, 32 * m_Scale);
+    }
+
+    m_Running = true;
+    m_Encoder = std::thread(&VideoRecorder::EncoderThread, this);
+
+    return true;
+}
+
+/* Queue a frame */
+void VideoRecorder::AddFrame(Chip8 &chip, bool wait)
+{
+    if(!m_File) return;
+
+    Frame f;
+    chip.GetScreenRows(f.rows);
+    while(!m_Queue.push(f))
+    {
+        if(!wait) {
+            m_Dropped++;
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/* Finish the file */
+void VideoRecorder::Close(void)
+{
+    if(!m_File) return;
+
+    m_Running = false;
+    m_Encoder.join();
+
+    if(m_GIF)
+    {
+        if(m_HavePending) WriteGIFFrame(m_Pending, m_PendingFrames);
+        fputc(0x3B, m_File); // trailer
+    }
+
+    fclose(m_File);
+    m_File = NULL;
+
+    if(m_Dropped)
+        fprintf(stderr, "VideoRecorder: %d frames dropped\n", m_Dropped);
+}
+
+/* Encode frames as they come in */
+void VideoRecorder::EncoderThread(void)
+{
+    for(;;)
+    {
+        bool running = m_Running;
+
+        Frame f;
+        while(m_Queue.pop(f))
+        {
+            if(!m_GIF)
+            {
+                WriteY4MFrame(f);
+                continue;
+            }
+
+            // a GIF frame is only written once we know how long it
+            // stays on screen
+            if(m_HavePending && memcmp(&f, &m_Pending, sizeof(f)) == 0)
+            {
+                m_PendingFrames++;
+                continue;
+            }
+
+            int carry = 0;
+            if(m_HavePending)
+            {
+                // viewers slow down delays under 2/100s, so frames that
+                // short are skipped and their time goes to the next one
+                int target = (m_FramesWritten + m_PendingFrames) * 100 / 60;
+                if(target - m_CentisWritten >= 2)
+                    WriteGIFFrame(m_Pending, m_PendingFrames);
+                else
+                    carry = m_PendingFrames;
+            }
+
+            m_Pending = f;
+            m_PendingFrames = 1 + carry;
+            m_HavePending = true;
+        }
+
+        if(!running) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+/* write a 16 bit little endian value */
+static void writeLE16(FILE *fp, int value)
+{
+    fputc(value & 0xFF, fp);
+    fputc((value >> 8) & 0xFF, fp);
+}
+
+/* is the screen pixel lit */
+static inline int pixel(const uint64_t *rows, int x, int y)
+{
+    return (rows[y] >> (63 - x)) & 1;
+}
+
+/* Raw planar frame */
+void VideoRecorder::WriteY4MFrame(const Frame &f)
+{
+    int w = 64 * m_Scale;
+    std::vector<BYTE> line(w);
+
+    fprintf(m_File, "FRAME\n");
+
+    // luma: lit pixels are black like on the display
+    for(int y=0; y<32; y++)
+    {
+        for(int x=0; x<w; x++)
+            line[x] = pixel(f.rows, x / m_Scale, y) ? 0 : 255;
+        for(int s=0; s<m_Scale; s++)
+            fwrite(&line[0], 1, w, m_File);
+    }
+
+    // no color: both chroma planes are the middle value
+    std::vector<BYTE> chroma((w/2) * (32*m_Scale/2), 128);
+    fwrite(&chroma[0], 1, chroma.size(), m_File);
+    fwrite(&chroma[0], 1, chroma.size(), m_File);
+}
+
+/* Screen size, palette and looping */
+void VideoRecorder::WriteGIFHeader(void)
+{
+    fwrite("GIF89a", 6, 1, m_File);
+    writeLE16(m_File, 64 * m_Scale);
+    writeLE16(m_File, 32 * m_Scale);
+    fputc(0x80, m_File); // 2 entry global color table
+    fputc(0, m_File);    // background color
+    fputc(0, m_File);    // aspect ratio
+
+    // 0 = white, 1 = black (lit)
+    const BYTE palette[6] = { 255, 255, 255, 0, 0, 0 };
+    fwrite(palette, 6, 1, m_File);
+
+    // loop forever
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19, 1, m_File);
+
+    memset(&m_Shown, 0, sizeof(m_Shown));
+}
+
+/* Write a frame that stays up for 'delayFrames' 60ths of a second */
+void VideoRecorder::WriteGIFFrame(const Frame &f, int delayFrames)
+{
+    // delays are in 1/100s, keep the total in step with 60hz
+    m_FramesWritten += delayFrames;
+    int target = m_FramesWritten * 100 / 60;
+    int delay = target - m_CentisWritten;
+    m_CentisWritten = target;
+
+    // graphic control extension: leave the old frame in place
+    fputc(0x21, m_File);
+    fputc(0xF9, m_File);
+    fputc(4, m_File);
+    fputc(0x04, m_File);
+    writeLE16(m_File, delay);
+    fputc(0, m_File);
+    fputc(0, m_File);
+
+    // the first frame covers the whole screen, after that only the
+    // rectangle around the pixels that changed
+    int x0 = 0, y0 = 0, x1 = 63, y1 = 31;
+    if(m_FramesWritten != delayFrames)
+    {
+        x0 = 64; y0 = 32; x1 = -1; y1 = -1;
+        for(int y=0; y<32; y++)
+        {
+            uint64_t changed = f.rows[y] ^ m_Shown.rows[y];
+            if(!changed) continue;
+
+            if(y < y0) y0 = y;
+            y1 = y;
+            int left = __builtin_clzll(changed);
+            int right = 63 - __builtin_ctzll(changed);
+            if(left < x0)  x0 = left;
+            if(right > x1) x1 = right;
+        }
+        // nothing changed, the frame just holds the picture longer
+        if(x1 < 0) { x0 = x1 = 0; y0 = y1 = 0; }
+    }
+
+    WriteGIFImage(f, x0, y0, x1, y1);
+    m_Shown = f;
+}
+
+/* LZW compressed image of screen pixels x0-x1, y0-y1 (inclusive) */
+void VideoRecorder::WriteGIFImage(const Frame &f, int x0, int y0, int x1, int y1)
+{
+    int s = m_Scale;
+    int w = (x1 - x0 + 1) * s;
+    int h = (y1 - y0 + 1) * s;
+
+    // image descriptor
+    fputc(0x2C, m_File);
+    writeLE16(m_File, x0 * s);
+    writeLE16(m_File, y0 * s);
+    writeLE16(m_File, w);
+    writeLE16(m_File, h);
+    fputc(0, m_File);
+
+    // 2 colors still need the minimum code size of 2
+    const int MIN_CODE_SIZE = 2;
+    const int CLEAR = 1 << MIN_CODE_SIZE;
+    const int END = CLEAR + 1;
+    fputc(MIN_CODE_SIZE, m_File);
+
+    // dict[code][pixel] = code for code+pixel, 0 if not there yet
+    static const int MAX_CODES = 4096;
+    std::vector<uint16_t> dict(MAX_CODES * 4, 0);
+    int codeSize = MIN_CODE_SIZE + 1;
+    int maxCode = END;
+
+    // bits are packed lsb first into blocks of up to 255 bytes
+    BYTE block[256];
+    int blockLen = 0;
+    uint32_t bits = 0;
+    int numBits = 0;
+
+#define PUT_CODE(code)                                          \
+    do {                                                        \
+        bits |= (uint32_t)(code) << numBits;                    \
+        numBits += codeSize;                                    \
+        while(numBits >= 8) {                                   \
+            block[blockLen++] = bits & 0xFF;                    \
+            bits >>= 8;                                         \
+            numBits -= 8;                                       \
+            if(blockLen == 255) {                               \
+                fputc(255, m_File);                             \
+                fwrite(block, 1, 255, m_File);                  \
+                blockLen = 0;                                   \
+            }                                                   \
+        }                                                       \
+    } while(0)
+
+    PUT_CODE(CLEAR);
+
+    int cur = -1;
+    for(int y=0; y<h; y++)
+    {
+        for(int x=0; x<w; x++)
+        {
+            int p = pixel(f.rows, x0 + x / s, y0 + y / s);
+            if(cur < 0) { cur = p; continue; }
+
+            uint16_t &next = dict[cur * 4 + p];
+            if(next) { cur = next; continue; }
+
+            PUT_CODE(cur);
+            next = ++maxCode;
+            if(maxCode >= (1 << codeSize)) codeSize++;
+
+            // table full: start again
+            if(maxCode == MAX_CODES - 1)
+            {
+                PUT_CODE(CLEAR);
+                std::fill(dict.begin(), dict.end(), 0);
+                codeSize = MIN_CODE_SIZE + 1;
+                maxCode = END;
+            }
+            cur = p;
+        }
+    }
+    PUT_CODE(cur);
+    PUT_CODE(END);
+#undef PUT_CODE
+
+    // flush the last bits and block, then the block terminator
+    if(numBits > 0) block[blockLen++] = bits & 0xFF;
+    if(blockLen > 0)
+    {
+        fputc(blockLen, m_File);
+        fwrite(block, 1, blockLen, m_File);
+    }
+    fputc(0, m_File);
+}
@@ -0,0 +1,77 @@
+/* Records the screen to a .y4m or .gif video */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Chip8.hpp"
+#include "RingBuffer.hpp"
+
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+// The emulation thread hands each frame over as the packed 1bpp screen
+// (256 bytes, see Chip8::GetScreenRows) through a fixed size ring, and
+// a background thread encodes it. Memory use doesn't grow with the
+// length of the recording.
+class VideoRecorder
+{
+public:
+    // constructor/deconstructor
+    VideoRecorder(void);
+    ~VideoRecorder(void);
+
+    // start recording. files ending in .gif are animated GIFs (only the
+    // changed rectangle is stored per frame), anything else is raw
+    // YUV4MPEG2. every screen pixel becomes scale x scale pixels
+    bool Open(const char *fname, int scale);
+
+    // add one 60hz frame. if the encoder is more than CAPTURE_QUEUE
+    // frames behind, the frame is dropped (and counted) unless 'wait'
+    // is set, which headless runs use since they outpace the encoder
+    void AddFrame(Chip8 &chip, bool wait);
+
+    // encode what's queued and finish the file
+    void Close(void);
+
+    int Dropped(void){return m_Dropped;}
+
+private:
+    struct Frame
+    {
+        uint64_t rows[32];
+    };
+
+    static const int CAPTURE_QUEUE = 256;
+
+    void EncoderThread(void);
+
+    void WriteY4MFrame(const Frame &f);
+
+    void WriteGIFHeader(void);
+    void WriteGIFFrame(const Frame &f, int delayFrames);
+    void WriteGIFImage(const Frame &f, int x0, int y0, int x1, int y1);
+
+    RingBuffer<Frame, CAPTURE_QUEUE> m_Queue;
+    std::atomic<bool> m_Running;
+    std::thread m_Encoder;
+
+    FILE *m_File;
+    bool  m_GIF;
+    int   m_Scale;
+    int   m_Dropped;
+
+    // (gif) the last frame written, the frame waiting for its delay
+    // to be known, and how long it has been on screen
+    Frame m_Shown;
+    Frame m_Pending;
+    bool  m_HavePending;
+    int   m_PendingFrames;
+    int   m_FramesWritten;  // in 60ths of a second
+    int   m_CentisWritten;  // the same in GIF delay units
+};
+
+#endif // CAPTURE_H_INCLUDED
@@ -1,9 +1,24 @@
 
 #include "Chip8.hpp"
+#include "Trace.hpp"
+#include "Profiler.hpp"
+#include "Aot.hpp"
+
+#include <cstring>
+#include <algorithm>
 
 /* Constructor/Deconstructor */
-Chip8::Chip8(void){}
-Chip8::~Chip8(void){}
+Chip8::Chip8(void)
+{
+    m_Tracer = NULL;
+    m_Profiler = NULL;
+    m_Aot = NULL;
+    SetQuirks(QuirksLegacy::Name());
+}
+Chip8::~Chip8(void)
+{
+    delete m_Aot;
+}
 
 /* Reset member variables */
 void Chip8::CPUReset(void)
@@ -13,11 +28,131 @@ void Chip8::CPUReset(void)
     
     m_DelayTimer = 0;
     m_SoundTimer = 0;
+    m_DelaySetCycle = 0;
+    m_SoundSetCycle = 0;
+
+    m_Cycles = 0;
+    m_CyclesPerTick = 400 / 60;
 
     m_Stack.assign(1, 0); // 1 entry with a value of 0
+
+    // start from a known state so runs can be repeated
+    memset(m_GameMemory, 0, sizeof(m_GameMemory));
+    memset(m_Registers, 0, sizeof(m_Registers));
+    memset(m_Keys, 0, sizeof(m_Keys));
+    memset(m_Screen, 0, sizeof(m_Screen)); // same as 00E0
+    InvalidateCode(0, sizeof(m_GameMemory));
     
-    // rand() used by CXNN
-    srand(time(0));
+    // Rand() used by CXNN
+    SetSeed(time(0));
+}
+
+/* Seed the random numbers used by CXNN */
+void Chip8::SetSeed(unsigned int seed)
+{
+    // xorshift gets stuck on 0
+    m_RandState = seed ? seed : 1;
+}
+
+/* Next random number (xorshift32) */
+unsigned int Chip8::Rand(void)
+{
+    m_RandState ^= m_RandState << 13;
+    m_RandState ^= m_RandState >> 17;
+    m_RandState ^= m_RandState << 5;
+    return m_RandState;
+}
+
+/* Copy the screen out as 1 bit per pixel */
+void Chip8::GetScreenRows(uint64_t rows[32])
+{
+    memcpy(rows, m_Screen, sizeof(m_Screen));
+}
+
+// snapshot layout: magic, then the fields in this order
+#define STATE_MAGIC "C8STATE3"
+
+/* copy a field in or out of a snapshot */
+#define STATE_FIELD(save, p, field)                     \
+    do {                                                \
+        if(save) memcpy(p, &(field), sizeof(field));    \
+        else     memcpy(&(field), p, sizeof(field));    \
+        p += sizeof(field);                             \
+    } while(0)
+
+/* Size of a snapshot */
+int Chip8::StateSize(void)
+{
+    return 8 + sizeof(m_GameMemory) + sizeof(m_Registers) +
+        sizeof(m_AddressI) + sizeof(m_PC) + sizeof(m_Screen) +
+        sizeof(WORD) + sizeof(WORD) * STATE_STACK_SIZE + sizeof(m_Keys) +
+        sizeof(m_DelayTimer) + sizeof(m_SoundTimer) + sizeof(m_DelaySetCycle) +
+        sizeof(m_SoundSetCycle) + sizeof(m_Cycles) + sizeof(m_CyclesPerTick) +
+        sizeof(m_RandState);
+}
+
+/* Copy the machine state into 'buf' (StateSize() bytes) */
+bool Chip8::SaveState(BYTE *buf)
+{
+    if(m_Stack.size() > STATE_STACK_SIZE) return false;
+
+    WORD depth = m_Stack.size();
+    WORD stack[STATE_STACK_SIZE] = {0};
+    std::copy(m_Stack.begin(), m_Stack.end(), stack);
+
+    BYTE *p = buf;
+    memcpy(p, STATE_MAGIC, 8);
+    p += 8;
+    STATE_FIELD(true, p, m_GameMemory);
+    STATE_FIELD(true, p, m_Registers);
+    STATE_FIELD(true, p, m_AddressI);
+    STATE_FIELD(true, p, m_PC);
+    STATE_FIELD(true, p, m_Screen);
+    STATE_FIELD(true, p, depth);
+    STATE_FIELD(true, p, stack);
+    STATE_FIELD(true, p, m_Keys);
+    STATE_FIELD(true, p, m_DelayTimer);
+    STATE_FIELD(true, p, m_SoundTimer);
+    STATE_FIELD(true, p, m_DelaySetCycle);
+    STATE_FIELD(true, p, m_SoundSetCycle);
+    STATE_FIELD(true, p, m_Cycles);
+    STATE_FIELD(true, p, m_CyclesPerTick);
+    STATE_FIELD(true, p, m_RandState);
+
+    return true;
+}
+
+/* Restore a snapshot made by SaveState() */
+bool Chip8::LoadState(const BYTE *buf)
+{
+    if(memcmp(buf, STATE_MAGIC, 8) != 0) return false;
+
+    WORD depth;
+    WORD stack[STATE_STACK_SIZE];
+
+    BYTE *p = (BYTE*)buf + 8;
+    STATE_FIELD(false, p, m_GameMemory);
+    STATE_FIELD(false, p, m_Registers);
+    STATE_FIELD(false, p, m_AddressI);
+    STATE_FIELD(false, p, m_PC);
+    STATE_FIELD(false, p, m_Screen);
+    STATE_FIELD(false, p, depth);
+    STATE_FIELD(false, p, stack);
+    STATE_FIELD(false, p, m_Keys);
+    STATE_FIELD(false, p, m_DelayTimer);
+    STATE_FIELD(false, p, m_SoundTimer);
+    STATE_FIELD(false, p, m_DelaySetCycle);
+    STATE_FIELD(false, p, m_SoundSetCycle);
+    STATE_FIELD(false, p, m_Cycles);
+    STATE_FIELD(false, p, m_CyclesPerTick);
+    STATE_FIELD(false, p, m_RandState);
+
+    if(depth > STATE_STACK_SIZE) depth = STATE_STACK_SIZE;
+    if(m_CyclesPerTick < 1) m_CyclesPerTick = 1;
+    m_Stack.assign(stack, stack + depth);
+    InvalidateCode(0, sizeof(m_GameMemory));
+
+    return true;
 }
 
 /* Load the ROM */
@@ -30,30 +165,225 @@ bool Chip8::LoadROM(const char *fname)
         return false;
     }
 
-    /* read the ROM into game memory */
-    fread(&m_GameMemory[0x200], 0xFFF, 1, fp);
+    /* read the ROM (whatever fits after 0x200) */
+    BYTE data[sizeof(m_GameMemory) - 0x200];
+    int size = fread(data, 1, sizeof(data), fp);
 
     /* close the file */
     fclose(fp);
 
+    LoadROM(data, size);
+
+    /* pick the quirk profile for this ROM */
+    char quirksFile[1024];
+    char name[32] = "";
+    snprintf(quirksFile, sizeof(quirksFile), "%s.quirks", fname);
+    fp = fopen(quirksFile, "r");
+    if(fp){
+        if(fscanf(fp, "%31s", name) != 1) name[0] = '\0';
+        fclose(fp);
+    }
+    if(!name[0] || !SetQuirks(name)){
+        if(name[0]){
+            fprintf(stderr, "Chip8::LoadROM: Unknown quirk profile '%s' "
+                "in '%s'\n", name, quirksFile);
+        }
+        SetQuirks(QuirksLegacy::Name());
+    }
+
     return true;
 }
 
-// decrease sound and delay timers (should be called at a rate
-// of 60hz)
-bool Chip8::DecreaseTimers(void)
+/* Load a ROM that is already in memory */
+bool Chip8::LoadROM(const BYTE *data, int size)
 {
-    if(m_DelayTimer > 0) m_DelayTimer--;
-    
-    if(m_SoundTimer > 0) {
-        // TODO - make beep here!
-        m_SoundTimer--;
+    if(size < 0 || size > (int)sizeof(m_GameMemory) - 0x200){
+        fprintf(stderr, "Chip8::LoadROM: ROM too big (%d bytes)\n", size);
+        return false;
     }
-    
-    
+
+    memcpy(&m_GameMemory[0x200], data, size);
+    InvalidateCode(0x200, 0x200 + size);
+
+    return true;
+}
+
+/* Replace part of the ROM */
+bool Chip8::PatchROM(int offset, const BYTE *data, int size)
+{
+    if(offset < 0 || size < 0 ||
+        0x200 + offset + size > (int)sizeof(m_GameMemory)) return false;
+
+    memcpy(&m_GameMemory[0x200 + offset], data, size);
+    InvalidateCode(0x200 + offset, 0x200 + offset + size);
+
+    return true;
+}
+
+/* Recheck compiled blocks on changed memory */
+void Chip8::InvalidateCode(WORD start, WORD end)
+{
+    if(m_Aot) m_Aot->Check(m_GameMemory, start, end);
+}
+
+/* Load a chip8aot module */
+bool Chip8::LoadAot(const char *fname)
+{
+    AotModule *aot = new AotModule;
+    if(!aot->Open(fname))
+    {
+        delete aot;
+        return false;
+    }
+
+    delete m_Aot;
+    m_Aot = aot;
+    InvalidateCode(0, sizeof(m_GameMemory));
+
+    fprintf(stderr, "Chip8::LoadAot: %d of %d blocks match the ROM\n",
+        m_Aot->Enabled(), m_Aot->Blocks());
+    return true;
+}
+
+/* Run instructions, compiled where possible */
+bool Chip8::RunCycles(int count)
+{
+    // the blocks stand in for the plain interpreter of one profile
+    bool compiled = m_Aot && m_Step == m_Execute &&
+        strcmp(m_QuirksName, m_Aot->Quirks()) == 0;
+
+    while(count > 0)
+    {
+        if(compiled)
+        {
+            const AotBlock *b = m_Aot->Find(m_PC);
+            if(b && b->count <= count)
+            {
+                b->run(*this);
+                count -= b->count;
+                continue;
+            }
+        }
+
+        if(!RunNextInstruction()) return false;
+        count--;
+    }
+
     return true;
 }
 
+/* Run until the frontend has something to do */
+Chip8Event Chip8::Run(int budget)
+{
+    Chip8Event ev;
+    ev.events = 0;
+    ev.cycles = 0;
+    ev.pc = m_PC;
+
+    // the sound timer runs out on a known instruction, so the budget
+    // stops there rather than the timer being checked every time
+    bool sound = SoundOn();
+    int limit = SoundCycles(budget);
+
+    while(ev.cycles < limit)
+    {
+        WORD pc = m_PC;
+        WORD op = (m_GameMemory[pc] << 8) | m_GameMemory[pc+1];
+
+        bool ok = RunNextInstruction();
+        ev.cycles++;
+
+        if(!ok) ev.events |= CHIP8_EVENT_BADOP;
+        else if(op == 0x00E0 || (op & 0xF000) == 0xD000)
+            ev.events |= CHIP8_EVENT_SCREEN;
+        else if((op & 0xF0FF) == 0xF00A && m_PC == pc)
+        {
+            // nothing happens until a key changes
+            ev.events |= CHIP8_EVENT_KEYWAIT;
+            SkipCycles(limit - ev.cycles);
+            ev.cycles = limit;
+        }
+        else if((op & 0xF0FF) == 0xF018)
+        {
+            if(SoundOn() != sound) ev.events |= CHIP8_EVENT_SOUND;
+            else limit = ev.cycles + SoundCycles(budget - ev.cycles);
+        }
+
+        if(ev.events)
+        {
+            ev.pc = pc;
+            break;
+        }
+    }
+
+    if(sound && !SoundOn() && !(ev.events & CHIP8_EVENT_SOUND))
+    {
+        if(!ev.events) ev.pc = m_PC;
+        ev.events |= CHIP8_EVENT_SOUND;
+    }
+    return ev;
+}
+
+/* Instructions until the beep stops */
+int Chip8::SoundCycles(int budget)
+{
+    if(!SoundOn()) return budget;
+
+    uint64_t end = (m_SoundSetCycle / m_CyclesPerTick + m_SoundTimer) *
+        m_CyclesPerTick;
+    return end - m_Cycles < (uint64_t)budget ? (int)(end - m_Cycles) : budget;
+}
+
+/* Pick the interpreter built for a quirk profile */
+bool Chip8::SetQuirks(const char *name)
+{
+#define SELECT_PROFILE(Q)                                       \
+    if(strcmp(name, Q::Name()) == 0) {                          \
+        m_Execute      = &Chip8::ExecuteNextInstruction<Q>;     \
+        m_Instrumented = &Chip8::InstrumentedNextInstruction<Q>;\
+        m_QuirksName   = Q::Name();                             \
+        UpdateStep();                                           \
+        return true;                                            \
+    }
+    CHIP8_QUIRK_PROFILES(SELECT_PROFILE)
+#undef SELECT_PROFILE
+
+    return false;
+}
+
+/* Start or stop tracing */
+void Chip8::AttachTracer(Tracer *tracer)
+{
+    m_Tracer = tracer;
+    UpdateStep();
+}
+
+/* Start or stop profiling */
+void Chip8::AttachProfiler(Profiler *profiler)
+{
+    m_Profiler = profiler;
+    UpdateStep();
+}
+
+/* Only pay for instrumentation while something is attached */
+void Chip8::UpdateStep(void)
+{
+    m_Step = (m_Tracer || m_Profiler) ? m_Instrumented : m_Execute;
+}
+
+/* Change how many instructions make a timer tick */
+void Chip8::SetCyclesPerTick(int cycles)
+{
+    // count the timers down at the old rate up to now, then go on
+    // from here at the new one
+    m_DelayTimer = DelayTimer();
+    m_SoundTimer = SoundTimer();
+    m_DelaySetCycle = m_Cycles;
+    m_SoundSetCycle = m_Cycles;
+
+    m_CyclesPerTick = cycles < 1 ? 1 : cycles;
+}
+
 bool Chip8::SetKey(int key, int val)
 {
     // TODO - should I check for valid values?
@@ -84,8 +414,9 @@ Opcode Chip8::GetNextOpcode(void)
 }
 
 // get the next opcode, decode it, and execute it (call the associated
-// function)
-bool Chip8::RunNextInstruction(void)
+// function). built once per quirk profile
+template<class Q>
+bool Chip8::ExecuteNextInstruction(void)
 {
     try
     {
@@ -137,13 +468,13 @@ bool Chip8::RunNextInstruction(void)
                         m_Op8XY0(op);
                         break;
                     case 0x1:
-                        m_Op8XY1(op);
+                        m_Op8XY1<Q>(op);
                         break;
                     case 0x2:
-                        m_Op8XY2(op);
+                        m_Op8XY2<Q>(op);
                         break;
                     case 0x3:
-                        m_Op8XY3(op);
+                        m_Op8XY3<Q>(op);
                         break;
                     case 0x4:
                         m_Op8XY4(op);
@@ -152,13 +483,13 @@ bool Chip8::RunNextInstruction(void)
                         m_Op8XY5(op);
                         break;
                     case 0x6:
-                        m_Op8XY6(op);
+                        m_Op8XY6<Q>(op);
                         break;
                     case 0x7:
                         m_Op8XY7(op);
                         break;
                     case 0xE:
-                        m_Op8XYE(op);
+                        m_Op8XYE<Q>(op);
                         break;
                     default:
                         throw op;
@@ -172,13 +503,13 @@ bool Chip8::RunNextInstruction(void)
                 m_OpANNN(op);
                 break;
             case 0xB:
-                m_OpBNNN(op);
+                m_OpBNNN<Q>(op);
                 break;
             case 0xC:
                 m_OpCXNN(op);
                 break;
             case 0xD:
-                m_OpDXYN(op);
+                m_OpDXYN<Q>(op);
                 break;
             case 0xE:
                 switch(op.Num34())
@@ -218,10 +549,10 @@ bool Chip8::RunNextInstruction(void)
                         m_OpFX33(op);
                         break;
                     case 0x55:
-                        m_OpFX55(op);
+                        m_OpFX55<Q>(op);
                         break;
                     case 0x65:
-                        m_OpFX65(op);
+                        m_OpFX65<Q>(op);
                         break;
                     default:
                         throw op;
@@ -236,8 +567,42 @@ bool Chip8::RunNextInstruction(void)
         fprintf(stderr, "Chip8::RunNextInstruction: Exception: ");
         fprintf(stderr, "Unhandled Opcode: 0x%X\n", o.getValue());
 
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     return true;
 }
+
+// run one instruction and tell the tracer and profiler what it did
+template<class Q>
+bool Chip8::InstrumentedNextInstruction(void)
+{
+    WORD pc = m_PC;
+    WORD opcode = (m_GameMemory[pc] << 8) | m_GameMemory[pc+1];
+
+    // registers before, as two words so finding a change is cheap
+    uint64_t before[2];
+    if(m_Tracer) memcpy(before, m_Registers, sizeof(before));
+
+    bool ok = ExecuteNextInstruction<Q>();
+
+    // the bottom entry isn't a call
+    if(m_Profiler)
+        m_Profiler->Step(opcode, m_Stack.empty() ? 0 : m_Stack.size() - 1);
+    if(!m_Tracer) return ok;
+
+    uint64_t after[2];
+    memcpy(after, m_Registers, sizeof(after));
+
+    // lowest changed register (byte order: little endian)
+    BYTE reg = TRACE_NO_REG;
+    if(after[0] != before[0])
+        reg = __builtin_ctzll(after[0] ^ before[0]) / 8;
+    else if(after[1] != before[1])
+        reg = 8 + __builtin_ctzll(after[1] ^ before[1]) / 8;
+
+    m_Tracer->Record(pc, opcode, m_AddressI, reg,
+        reg == TRACE_NO_REG ? 0 : m_Registers[reg]);
+
+    return ok;
+}
@@ -4,9 +4,17 @@
 #include <cstdlib>
 #include <vector>
 
+#include <stdint.h>
+
 #include <climits>
 #include <ctime>
 
+#include "Quirks.hpp"
+
+class Tracer;
+class Profiler;
+class AotModule;
+
 #ifndef CHIP8_H_INCLUDED
 #define CHIP8_H_INCLUDED
 
@@ -14,6 +22,21 @@
 typedef unsigned char BYTE;
 typedef unsigned short int WORD;
 
+// what made Chip8::Run() stop, as bits of Chip8Event::events
+#define CHIP8_EVENT_SCREEN  0x01 // DXYN or 00E0 ran
+#define CHIP8_EVENT_KEYWAIT 0x02 // FX0A is waiting for a key
+#define CHIP8_EVENT_SOUND   0x04 // the sound timer started or stopped
+#define CHIP8_EVENT_BADOP   0x08 // unhandled opcode at 'pc'; the PC has
+                                 // moved past it like any other
+
+/* what Chip8::Run() did */
+struct Chip8Event
+{
+    int  events;  // CHIP8_EVENT_* bits, 0 if the budget ran out
+    int  cycles;  // instructions run (or waited out)
+    WORD pc;      // address of the instruction that stopped it
+};
+
 /* decodes an instruction (1 word/2 bytes) */
 class Opcode
 {
@@ -47,17 +70,77 @@ public:
     // reset member variables
     void CPUReset(void);
 
-    // load the ROM
+    // seed the random numbers used by CXNN (CPUReset() seeds from the
+    // time). the same seed, ROM and keys always give the same run
+    void SetSeed(unsigned int seed);
+
+    // load the ROM. the quirk profile is picked from a '<ROM>.quirks'
+    // file next to it (containing a profile name), otherwise legacy
     bool LoadROM(const char *fname);
+
+    // load a ROM from memory (keeps the current quirk profile)
+    bool LoadROM(const BYTE *data, int size);
+
+    // overwrite 'size' bytes of the loaded ROM from 'offset' (0 is
+    // 0x200) with a rebuilt version, leaving the rest of the machine as
+    // it is. returns false if it doesn't fit in memory
+    bool PatchROM(int offset, const BYTE *data, int size);
+
+    // the code in memory from 'start' up to 'end' has changed; compiled
+    // blocks on it are only used again once it matches what they were
+    // compiled from
+    void InvalidateCode(WORD start, WORD end);
+
+    // use a module made by chip8aot for this ROM. RunCycles() then runs
+    // its blocks where memory still holds the code they came from, and
+    // interprets everything else. false if it can't be loaded
+    bool LoadAot(const char *fname);
+
+    // run the interpreter built for a quirk profile ("legacy", "vip"
+    // or "schip"). returns false for an unknown name
+    bool SetQuirks(const char *name);
+    const char *GetQuirks(void){return m_QuirksName;}
+
+    // record every instruction into 'tracer' (NULL to stop). the
+    // untraced interpreter is used while nothing is attached
+    void AttachTracer(Tracer *tracer);
+
+    // count every instruction into 'profiler' by guest call stack
+    // (NULL to stop). works alongside a tracer
+    void AttachProfiler(Profiler *profiler);
     
-    // decrease sound and delay timers (should be called at a rate
-    // of 60hz)
-    bool DecreaseTimers(void);
+    // instructions per 60hz timer tick (CPUReset() sets 400/60). the
+    // timers are worked out from the instruction count when they're
+    // read, so nothing has to be called per frame
+    void SetCyclesPerTick(int cycles);
+
+    // let 'cycles' instructions' worth of time pass without running
+    // anything (the timers count down as if they had run)
+    void SkipCycles(uint64_t cycles){m_Cycles += cycles;}
+    uint64_t GetCycles(void){return m_Cycles;}
+
+    // current timer values
+    BYTE DelayTimer(void){return TimerValue(m_DelayTimer, m_DelaySetCycle);}
+    BYTE SoundTimer(void){return TimerValue(m_SoundTimer, m_SoundSetCycle);}
+
+    // is the sound timer running (the beep should be playing)
+    bool SoundOn(void){return SoundTimer() > 0;}
     
     // set a key value with key number 'key' and value 1 (on)
     // or 0 (off)
     bool SetKey(int key, int val);
 
+    // the 64x32 screen, 1 bit per pixel: bit 63 of rows[y] is x = 0,
+    // set bits are lit
+    void GetScreenRows(uint64_t rows[32]);
+
+    // snapshots of the whole machine (memory, registers, stack, screen,
+    // keys, timers and random state). the quirk profile and any tracer
+    // are not part of it
+    static int StateSize(void);
+    bool SaveState(BYTE *buf);        // false if the stack is too deep
+    bool LoadState(const BYTE *buf);  // false if 'buf' isn't a snapshot
+
 //private:
 
     // Convert the 2 bytes at m_PC to a WORD
@@ -65,8 +148,48 @@ public:
     Opcode GetNextOpcode(void);
 
     // get the next opcode, decode it, and execute it (call the associated
-    // function)
-    bool RunNextInstruction(void);
+    // function). returns false on an unhandled opcode
+    bool RunNextInstruction(void)
+    {
+        bool ok = (this->*m_Step)();
+        m_Cycles++;
+        return ok;
+    }
+
+    // run 'count' instructions, through the compiled blocks of a loaded
+    // module while no tracer or profiler is attached. returns false on
+    // an unhandled opcode
+    bool RunCycles(int count);
+
+    // run up to 'budget' instructions, stopping after the first one
+    // that changes something a frontend shows or plays: the screen, the
+    // beep, or the machine waiting on FX0A (the rest of the budget is
+    // then waited out at once, as FX0A would). always interpreted
+    Chip8Event Run(int budget);
+
+    // instructions until the sound timer runs out, at most 'budget'
+    int SoundCycles(int budget);
+
+    // RunNextInstruction() for one quirk profile
+    template<class Q> bool ExecuteNextInstruction(void);
+
+    // ExecuteNextInstruction() plus reporting to the attached tracer
+    // and profiler
+    template<class Q> bool InstrumentedNextInstruction(void);
+
+    // point m_Step at the plain or instrumented interpreter
+    void UpdateStep(void);
+
+    // random number for CXNN
+    unsigned int Rand(void);
+
+    // a timer written with 'value' at 'setCycle', counted down to now.
+    // ticks fall on multiples of m_CyclesPerTick, before that instruction
+    BYTE TimerValue(BYTE value, uint64_t setCycle)
+    {
+        uint64_t ticks = m_Cycles / m_CyclesPerTick - setCycle / m_CyclesPerTick;
+        return ticks >= value ? 0 : value - ticks;
+    }
 
     //////////////////////////////////////////////////////////////////
     //                 Opcode Instruction Functions                 //
@@ -88,24 +211,24 @@ public:
     void m_Op6XNN(Opcode op);
     void m_Op7XNN(Opcode op);
     void m_Op8XY0(Opcode op);
-    void m_Op8XY1(Opcode op);
-    void m_Op8XY2(Opcode op);
-    void m_Op8XY3(Opcode op);
+    template<class Q> void m_Op8XY1(Opcode op);
+    template<class Q> void m_Op8XY2(Opcode op);
+    template<class Q> void m_Op8XY3(Opcode op);
     void m_Op8XY4(Opcode op);
     void m_Op8XY5(Opcode op);
-    void m_Op8XY6(Opcode op);
+    template<class Q> void m_Op8XY6(Opcode op);
     void m_Op8XY7(Opcode op);
-    void m_Op8XYE(Opcode op);
+    template<class Q> void m_Op8XYE(Opcode op);
     
     void m_Op9XY0(Opcode op);
 
     void m_OpANNN(Opcode op);
     
-    void m_OpBNNN(Opcode op);
+    template<class Q> void m_OpBNNN(Opcode op);
     
     void m_OpCXNN(Opcode op);
 
-    void m_OpDXYN(Opcode op);
+    template<class Q> void m_OpDXYN(Opcode op);
     
     // key handlers (if key == Vx or if key != Vx)
     void m_OpEX9E(Opcode op);
@@ -125,9 +248,9 @@ public:
 
     void m_OpFX33(Opcode op);
 
-    void m_OpFX55(Opcode op);
+    template<class Q> void m_OpFX55(Opcode op);
     
-    void m_OpFX65(Opcode op);
+    template<class Q> void m_OpFX65(Opcode op);
 
     //////////////////////////////////////////////////////////////////
 
@@ -136,15 +259,36 @@ public:
     WORD m_AddressI;          // 16 bit address register I
     WORD m_PC;                // 16 bit program counter
 
-    //BYTE m_ScreenData[64][32]; // screen pixels
-    BYTE m_ScreenData[320][640][3]; // y,x,3 channels
-    //BYTE m_ScreenData[64*32*3]; // screen pixels - width, height, rgb
+    // screen pixels, 1 bit each: bit 63 of a row is x = 0, set bits
+    // are lit. scaling and colors are up to the frontend
+    uint64_t m_Screen[32];
 
     std::vector<WORD> m_Stack;      // 16 bit stack
     
     BYTE m_Keys[16];   // 16 keys 0-F
+    // the timers as (value written, m_Cycles when written)
     BYTE m_DelayTimer;
     BYTE m_SoundTimer;
+    uint64_t m_DelaySetCycle;
+    uint64_t m_SoundSetCycle;
+
+    uint64_t m_Cycles;        // instructions run (or skipped) since reset
+    int m_CyclesPerTick;
+
+    unsigned int m_RandState; // per instance so runs are repeatable
+
+    // deepest stack a snapshot can hold (including the bottom entry)
+    static const int STATE_STACK_SIZE = 64;
+
+    // interpreter for the current quirk profile
+    bool (Chip8::*m_Step)(void);
+    bool (Chip8::*m_Execute)(void);      // plain
+    bool (Chip8::*m_Instrumented)(void); // with tracing
+    const char *m_QuirksName;
+
+    Tracer *m_Tracer;
+    Profiler *m_Profiler;
+    AotModule *m_Aot;
 };
 
 #endif // CHIP8_H_INCLUDED
@@ -0,0 +1,335 @@
+/* Works out how fast to run each ROM and remembers it */
+
+#include "ClockTuner.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the most a ROM can be, the same as Chip8::LoadROM() takes (memory
+// after 0x200)
+#define CLOCK_MAX_ROM (sizeof(((Chip8 *)0)->m_GameMemory) - 0x200)
+
+// the rates tried, slowest first
+static const int clockRates[] = {
+    300, 400, 500, 600, 700, 800, 1000, 1200, 1500, 2000
+};
+static const int numClockRates = sizeof(clockRates) / sizeof(clockRates[0]);
+
+/* FNV-1a */
+uint64_t RomHash(const BYTE *data, int size)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for(int i=0; i<size; i++)
+    {
+        h ^= data[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/* read a whole ROM file */
+static bool readRom(const char *fname, std::vector<BYTE> &rom)
+{
+    FILE *fp = fopen(fname, "rb");
+    if(!fp) return false;
+
+    rom.resize(CLOCK_MAX_ROM);
+    rom.resize(fread(&rom[0], 1, CLOCK_MAX_ROM, fp));
+    fclose(fp);
+    return true;
+}
+
+/* Where the profiles go if not told */
+std::string ClockProfiles::DefaultPath(void)
+{
+#ifdef __WIN32
+    const char *home = getenv("USERPROFILE");
+#else
+    const char *home = getenv("HOME");
+#endif
+    std::string path = home ? home : ".";
+    return path + "/.chip8-clocks";
+}
+
+/* Read the profiles */
+bool ClockProfiles::Load(const char *fname)
+{
+    m_Path = fname;
+    m_Entries.clear();
+
+    FILE *fp = fopen(fname, "r");
+    if(!fp) return true;
+
+    char line[256];
+    while(fgets(line, sizeof(line), fp))
+    {
+        Entry e;
+        unsigned long long hash;
+        int noteAt = 0;
+        if(line[0] == '#' ||
+            sscanf(line, "%llx %d %n", &hash, &e.opsPerSec, &noteAt) < 2 ||
+            e.opsPerSec <= 0) continue;
+
+        e.hash = hash;
+        e.note = line + noteAt;
+        while(!e.note.empty() && (e.note[e.note.size()-1] == '\n' ||
+            e.note[e.note.size()-1] == '\r')) e.note.erase(e.note.size()-1);
+        m_Entries.push_back(e);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/* Look up a ROM */
+int ClockProfiles::Find(uint64_t hash)
+{
+    for(size_t i=0; i<m_Entries.size(); i++)
+        if(m_Entries[i].hash == hash) return m_Entries[i].opsPerSec;
+    return 0;
+}
+
+/* Look up a ROM file */
+int ClockProfiles::FindFile(const char *romFile)
+{
+    std::vector<BYTE> rom;
+    if(!readRom(romFile, rom)) return 0;
+    return Find(RomHash(rom.empty() ? NULL : &rom[0], rom.size()));
+}
+
+/* Add or replace a ROM */
+void ClockProfiles::Set(uint64_t hash, int opsPerSec, const char *note)
+{
+    Entry e;
+    e.hash = hash;
+    e.opsPerSec = opsPerSec;
+    e.note = note;
+
+    for(size_t i=0; i<m_Entries.size(); i++)
+    {
+        if(m_Entries[i].hash == hash)
+        {
+            m_Entries[i] = e;
+            return;
+        }
+    }
+    m_Entries.push_back(e);
+}
+
+/* Write the profiles */
+bool ClockProfiles::Save(void)
+{
+    // written to the side and renamed, so a running emulator never
+    // reads half a file
+    std::string tmp = m_Path + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if(!fp)
+    {
+        fprintf(stderr, "ClockProfiles::Save: can't write '%s'\n", tmp.c_str());
+        return false;
+    }
+
+    fprintf(fp, "# ROM hash, instructions per second, note\n");
+    for(size_t i=0; i<m_Entries.size(); i++)
+    {
+        fprintf(fp, "%016llx %d %s\n", (unsigned long long)m_Entries[i].hash,
+            m_Entries[i].opsPerSec, m_Entries[i].note.c_str());
+    }
+
+    bool ok = fclose(fp) == 0;
+#ifdef __WIN32
+    remove(m_Path.c_str());
+#endif
+    if(!ok || rename(tmp.c_str(), m_Path.c_str()) != 0)
+    {
+        fprintf(stderr, "ClockProfiles::Save: can't write '%s'\n", m_Path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Constructor */
+ClockTuner::ClockTuner(void)
+{
+    m_Hash = 0;
+    m_Quirks = NULL;
+}
+
+/* Read the ROM */
+bool ClockTuner::Open(const char *romFile, const char *quirks)
+{
+    // the same profile a normal run would get
+    Chip8 chip;
+    if(!chip.LoadROM(romFile) || !readRom(romFile, m_Rom)) return false;
+    if(quirks && !chip.SetQuirks(quirks))
+    {
+        fprintf(stderr, "Unknown quirk profile '%s'\n", quirks);
+        return false;
+    }
+
+    m_Quirks = chip.GetQuirks();
+    m_Hash = RomHash(m_Rom.empty() ? NULL : &m_Rom[0], m_Rom.size());
+    return true;
+}
+
+/* Is a backwards jump the end of a wait */
+bool ClockTuner::IsWaitLoop(Chip8 &chip, WORD target, WORD pc)
+{
+    // a loop running off the end of memory isn't waiting for anything
+    if(pc + 1u >= sizeof(chip.m_GameMemory)) return false;
+
+    for(WORD a=target; a<=pc; a+=2)
+    {
+        WORD op = (chip.m_GameMemory[a] << 8) | chip.m_GameMemory[a+1];
+        switch(op & 0xF000)
+        {
+        case 0x1000:          // jumps
+        case 0x3000:          // skips on registers
+        case 0x4000:
+            continue;
+        case 0x5000:
+        case 0x9000:
+            if((op & 0x000F) == 0) continue;
+            return false;
+        case 0xE000:          // key checks
+            if((op & 0x00FF) == 0x9E || (op & 0x00FF) == 0xA1) continue;
+            return false;
+        case 0xF000:          // reading the delay timer, waiting for a key
+            if((op & 0x00FF) == 0x07 || (op & 0x00FF) == 0x0A) continue;
+            return false;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Run the ROM at one rate */
+ClockResult ClockTuner::Measure(int opsPerSec)
+{
+    ClockResult r;
+    r.opsPerSec = opsPerSec;
+    r.idle = 0;
+    r.draws = 0;
+    r.crashed = false;
+
+    int ops = opsPerSec / 60;
+
+    Chip8 chip;
+    chip.CPUReset();
+    chip.SetSeed(1);
+    chip.LoadROM(m_Rom.empty() ? NULL : &m_Rom[0], m_Rom.size());
+    chip.SetQuirks(m_Quirks);
+    chip.SetCyclesPerTick(ops);
+
+    // per address: part of a wait loop, and jumps already looked at
+    std::vector<BYTE> waiting(sizeof(chip.m_GameMemory), 0);
+    std::vector<BYTE> checked(sizeof(chip.m_GameMemory), 0);
+
+    uint64_t total = 0, idle = 0, draws = 0;
+    unsigned int keyRand = 1;
+    int key = 0, keyFrames = 0;
+
+    for(int f=0; f<CLOCK_FRAMES && !r.crashed; f++)
+    {
+        // a random key for a few frames every half second
+        if(f % 30 == 0)
+        {
+            keyRand = keyRand * 1103515245 + 12345;
+            key = (keyRand >> 16) & 15;
+            keyFrames = 6;
+            chip.SetKey(key, 1);
+        }
+        else if(keyFrames > 0 && --keyFrames == 0) chip.SetKey(key, 0);
+
+        for(int i=0; i<ops; i++)
+        {
+            WORD pc = chip.m_PC;
+            WORD op = pc < 0xFFE ?
+                (chip.m_GameMemory[pc] << 8) | chip.m_GameMemory[pc+1] : 0;
+
+            if(!chip.RunNextInstruction())
+            {
+                r.crashed = true;
+                break;
+            }
+            total++;
+
+            if((op & 0xF000) == 0xD000) draws++;
+
+            if((op & 0xF0FF) == 0xF00A)
+            {
+                if(chip.m_PC == pc) idle++;
+            }
+            else if(waiting[pc]) idle++;
+            else if((op & 0xF000) == 0x1000 && !checked[pc])
+            {
+                WORD target = op & 0x0FFF;
+                checked[pc] = 1;
+                if(target <= pc && pc - target < 2 * CLOCK_WAIT_LOOP &&
+                    IsWaitLoop(chip, target, pc))
+                {
+                    for(WORD a=target; a<=pc; a+=2) waiting[a] = 1;
+                    idle++;
+                }
+            }
+        }
+    }
+
+    if(total) r.idle = (double)idle / total;
+    r.draws = (double)draws / CLOCK_FRAMES;
+    return r;
+}
+
+/* Try every rate */
+int ClockTuner::Calibrate(void)
+{
+    ClockResult results[numClockRates];
+    const ClockResult *fastest = NULL;
+
+    printf("  ops/s  ops/frame  waiting  draws/frame\n");
+    for(int i=0; i<numClockRates; i++)
+    {
+        results[i] = Measure(clockRates[i]);
+        const ClockResult &r = results[i];
+        if(r.crashed)
+        {
+            printf("  %5d  %9d  crashed\n", r.opsPerSec, r.opsPerSec / 60);
+            continue;
+        }
+        printf("  %5d  %9d  %6.1f%%  %11.2f\n", r.opsPerSec, r.opsPerSec / 60,
+            100.0 * r.idle, r.draws);
+        fastest = &results[i];
+    }
+
+    if(!fastest)
+    {
+        printf("Crashes at every rate, keeping %d\n", CLOCK_DEFAULT);
+        return CLOCK_DEFAULT;
+    }
+
+    for(int i=0; i<numClockRates; i++)
+    {
+        const ClockResult &r = results[i];
+        if(!r.crashed && r.idle >= CLOCK_MIN_IDLE &&
+            r.draws >= CLOCK_MIN_DRAWS * fastest->draws)
+        {
+            printf("Picked %d: the slowest rate with time to spare\n",
+                r.opsPerSec);
+            return r.opsPerSec;
+        }
+    }
+
+    // waits, but never gets far enough ahead to wait much
+    if(fastest->idle >= CLOCK_MIN_IDLE / 4)
+    {
+        printf("Picked %d: never much time to spare\n", fastest->opsPerSec);
+        return fastest->opsPerSec;
+    }
+
+    printf("Never waits for the timer, so its speed is the clock's: "
+        "keeping %d\n", CLOCK_DEFAULT);
+    return CLOCK_DEFAULT;
+}
@@ -0,0 +1,109 @@
+/* Works out how fast to run each ROM and remembers it */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#ifndef CLOCKTUNER_H_INCLUDED
+#define CLOCKTUNER_H_INCLUDED
+
+// instructions per second when a ROM has no profile
+#define CLOCK_DEFAULT 400
+
+// frames each rate is tried for (a minute of game time)
+#define CLOCK_FRAMES 3600
+
+// longest loop (in instructions) that can count as waiting
+#define CLOCK_WAIT_LOOP 8
+
+// a rate is fast enough once this much of the time is spent waiting...
+#define CLOCK_MIN_IDLE 0.20
+
+// ...and the game draws at least this much of what it draws at the
+// fastest rate
+#define CLOCK_MIN_DRAWS 0.90
+
+/* FNV-1a of a ROM's bytes, what profiles are looked up by */
+uint64_t RomHash(const BYTE *data, int size);
+
+// The instructions per second for each ROM, as lines of
+// "<hash> <ops per second> <note>" in a text file. The hash is of the
+// ROM's contents, so renamed or copied ROMs keep their rate.
+class ClockProfiles
+{
+public:
+    // $HOME/.chip8-clocks (%USERPROFILE% on Windows)
+    static std::string DefaultPath(void);
+
+    // read 'fname'. a missing file is just empty
+    bool Load(const char *fname);
+
+    // the rate for a ROM, 0 if there isn't one
+    int Find(uint64_t hash);
+    int FindFile(const char *romFile);
+
+    // add or replace a ROM's rate, then write the file
+    void Set(uint64_t hash, int opsPerSec, const char *note);
+    bool Save(void);
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        int opsPerSec;
+        std::string note;
+    };
+
+    std::string m_Path;
+    std::vector<Entry> m_Entries;
+};
+
+/* what one rate did */
+struct ClockResult
+{
+    int opsPerSec;
+    double idle;       // share of instructions spent in wait loops
+    double draws;      // DXYN per frame
+    bool crashed;      // hit an unhandled opcode
+};
+
+// Runs a ROM headless at a range of rates (with keys pressed now and
+// then so it gets past title screens) and picks one.
+//
+// An instruction counts as waiting if it's FX0A with no key down, or
+// part of a short backwards loop made of nothing but FX07, key checks,
+// skips and jumps: the game is waiting for the delay timer or a key.
+// Games paced by the delay timer draw the same amount per frame at any
+// rate that's fast enough and wait out the rest, so the slowest rate
+// that still waits CLOCK_MIN_IDLE of the time and draws as much as the
+// fastest is picked. Games that never wait run at whatever speed the
+// clock gives them, so they're left at CLOCK_DEFAULT.
+class ClockTuner
+{
+public:
+    ClockTuner(void);
+
+    // read the ROM. the quirk profile is picked like Chip8::LoadROM()
+    // does unless 'quirks' is given
+    bool Open(const char *romFile, const char *quirks);
+    uint64_t Hash(void){return m_Hash;}
+
+    // try each rate and print a table, returns the rate picked
+    int Calibrate(void);
+
+    // run the ROM for CLOCK_FRAMES at 'opsPerSec'
+    ClockResult Measure(int opsPerSec);
+
+private:
+    // is the loop ending with the jump at 'pc' back to 'target' a wait
+    bool IsWaitLoop(Chip8 &chip, WORD target, WORD pc);
+
+    std::vector<BYTE> m_Rom;
+    uint64_t m_Hash;
+    const char *m_Quirks;
+};
+
+#endif // CLOCKTUNER_H_INCLUDED
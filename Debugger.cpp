@@ -0,0 +1,421 @@
+/* Interactive debugger driven over stdin or a local socket */
+
+#include "Debugger.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the Windows build has stdin only, and can't check it without waiting
+#ifndef __WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+/* Constructor */
+Debugger::Debugger(Chip8 &chip) : m_Chip(chip)
+{
+    m_InFd = -1;
+    m_Out = NULL;
+    m_ListenFd = -1;
+    m_ClientFd = -1;
+    m_Closed = false;
+    m_Quit = false;
+
+    // start stopped so breakpoints can be set before the ROM runs
+    m_Stopped = true;
+    m_Steps = 0;
+    m_SkipBreak = false;
+}
+
+/* Deconstructor */
+Debugger::~Debugger(void)
+{
+    if(m_ClientFd >= 0)
+    {
+        fclose(m_Out);
+        close(m_ClientFd);
+    }
+    if(m_ListenFd >= 0) close(m_ListenFd);
+}
+
+/* Commands from the terminal */
+bool Debugger::OpenStdin(void)
+{
+    m_InFd = STDIN_FILENO;
+    m_Out = stdout;
+
+    Stop("attached");
+    return true;
+}
+
+/* Commands from a socket */
+bool Debugger::Listen(int port)
+{
+#ifdef __WIN32
+    (void)port;
+    fprintf(stderr, "Debugger::Listen: --debug-port isn't in the Windows build\n");
+    return false;
+#else
+    m_ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(m_ListenFd < 0)
+    {
+        perror("Debugger::Listen: socket");
+        return false;
+    }
+
+    int yes = 1;
+    setsockopt(m_ListenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    // local connections only
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(m_ListenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(m_ListenFd, 1) < 0)
+    {
+        perror("Debugger::Listen: bind");
+        return false;
+    }
+
+    fprintf(stderr, "Debugger: waiting for a connection on 127.0.0.1:%d\n",
+        port);
+    m_ClientFd = accept(m_ListenFd, NULL, NULL);
+    if(m_ClientFd < 0)
+    {
+        perror("Debugger::Listen: accept");
+        return false;
+    }
+
+    m_InFd = m_ClientFd;
+    m_Out = fdopen(dup(m_ClientFd), "w");
+
+    Stop("attached");
+    return true;
+#endif
+}
+
+/* Add whatever input is there to m_Pending */
+bool Debugger::ReadInput(bool block)
+{
+    if(m_Closed) return false;
+
+#ifdef __WIN32
+    // "p" only works while stopped
+    if(!block) return false;
+#else
+    struct pollfd p;
+    p.fd = m_InFd;
+    p.events = POLLIN;
+    if(poll(&p, 1, block ? -1 : 0) <= 0) return false;
+#endif
+
+    char buf[256];
+    int got = read(m_InFd, buf, sizeof(buf));
+    if(got <= 0)
+    {
+        // input gone - let the game run on
+        m_Closed = true;
+        m_Stopped = false;
+        return false;
+    }
+    m_Pending.append(buf, got);
+
+    return true;
+}
+
+/* Wait for the next line of input */
+bool Debugger::ReadLine(std::string &line)
+{
+    for(;;)
+    {
+        size_t nl = m_Pending.find('\n');
+        if(nl != std::string::npos)
+        {
+            line = m_Pending.substr(0, nl);
+            m_Pending.erase(0, nl+1);
+            return true;
+        }
+        if(!ReadInput(true)) return false;
+    }
+}
+
+/* Was "p" typed while the game runs */
+bool Debugger::PauseRequested(void)
+{
+    ReadInput(false);
+
+    size_t p = (m_Pending.compare(0, 2, "p\n") == 0) ? 0 : m_Pending.find("\np\n");
+    if(p == std::string::npos) return false;
+
+    m_Pending.erase(p, 2);
+    return true;
+}
+
+/* Tell the user why we stopped */
+void Debugger::Stop(const char *why)
+{
+    m_Stopped = true;
+    m_Steps = 0;
+
+    // the PC can run onto the last byte of memory, or past it
+    WORD pc = m_Chip.m_PC;
+    const WORD size = sizeof(m_Chip.m_GameMemory);
+    fprintf(m_Out, "stopped (%s) at %03X: ", why, pc);
+    if(pc + 1 < size)
+        fprintf(m_Out, "%02X%02X\n", m_Chip.m_GameMemory[pc],
+            m_Chip.m_GameMemory[pc+1]);
+    else if(pc < size)
+        fprintf(m_Out, "%02X\n", m_Chip.m_GameMemory[pc]);
+    else
+        fprintf(m_Out, "past the end of memory\n");
+    fflush(m_Out);
+}
+
+/* Does a breakpoint match at the PC */
+int Debugger::CheckBreakpoints(void)
+{
+    for(size_t i=0; i<m_Breakpoints.size(); i++)
+    {
+        Breakpoint &b = m_Breakpoints[i];
+        if(b.addr != m_Chip.m_PC) continue;
+        if(b.reg < 0) return i;
+
+        int v = m_Chip.m_Registers[b.reg];
+        if((b.op == "==" && v == b.value) || (b.op == "!=" && v != b.value) ||
+           (b.op == "<"  && v <  b.value) || (b.op == ">"  && v >  b.value) ||
+           (b.op == "<=" && v <= b.value) || (b.op == ">=" && v >= b.value))
+            return i;
+    }
+    return -1;
+}
+
+/* Memory the next instruction will write */
+bool Debugger::WrittenRange(WORD &start, WORD &end)
+{
+    WORD pc = m_Chip.m_PC;
+    if(pc + 1 >= (int)sizeof(m_Chip.m_GameMemory)) return false; // no FX there
+
+    BYTE hi = m_Chip.m_GameMemory[pc];
+    BYTE lo = m_Chip.m_GameMemory[pc+1];
+
+    if((hi & 0xF0) != 0xF0) return false;
+
+    start = m_Chip.m_AddressI;
+    if(lo == 0x33)      end = start + 2;             // FX33
+    else if(lo == 0x55) end = start + (hi & 0x0F);   // FX55
+    else return false;
+
+    return true;
+}
+
+/* Run up to 'count' instructions */
+bool Debugger::Run(int count)
+{
+    std::string line;
+
+    for(int i=0; i<count; i++)
+    {
+        // "p" while the game runs. anything else waits for the next
+        // stop, so scripts can queue commands after "c"
+        if(!m_Stopped && i == 0 && PauseRequested()) Stop("paused");
+
+        if(!m_Stopped && !m_SkipBreak && !m_Closed)
+        {
+            int b = CheckBreakpoints();
+            if(b >= 0)
+            {
+                char why[32];
+                snprintf(why, sizeof(why), "breakpoint %d", b);
+                Stop(why);
+            }
+        }
+
+        // wait for commands until something makes us run again
+        while(m_Stopped)
+        {
+            if(ReadLine(line))
+            {
+                if(Command(line)) m_SkipBreak = true;
+                if(m_Quit) return true;
+            }
+            else if(m_Closed) break;
+        }
+
+        WORD start = 0, end = 0;
+        bool writes = WrittenRange(start, end);
+        WORD pc = m_Chip.m_PC;
+
+        if(!m_Chip.RunNextInstruction())
+        {
+            if(!m_Closed) Stop("unhandled opcode");
+            return false;
+        }
+        m_SkipBreak = false;
+
+        // watchpoints stop after the write so the new value shows
+        for(size_t w=0; writes && !m_Closed && w<m_Watchpoints.size(); w++)
+        {
+            if(start <= m_Watchpoints[w].end && end >= m_Watchpoints[w].start)
+            {
+                fprintf(m_Out, "watchpoint %d: %03X wrote %03X-%03X\n",
+                    (int)(m_Breakpoints.size() + w), pc, start, end);
+                Stop("watchpoint");
+                break;
+            }
+        }
+
+        if(m_Steps > 0 && --m_Steps == 0) Stop("step");
+    }
+
+    return true;
+}
+
+/* Run one command */
+bool Debugger::Command(const std::string &line)
+{
+    char cmd[16] = "";
+    char rest[128] = "";
+    if(sscanf(line.c_str(), "%15s %127[^\n]", cmd, rest) < 1) return false;
+
+    bool resume = false;
+
+    if(strcmp(cmd, "b") == 0)
+    {
+        Breakpoint b;
+        char op[3] = "";
+        unsigned int addr, reg, value;
+        int got = sscanf(rest, "%x if v%1x %2[=!<>] %x", &addr, &reg, op, &value);
+        if(got == 1 || got == 4)
+        {
+            b.addr = addr;
+            b.reg = (got == 4) ? (int)reg : -1;
+            b.op = op;
+            b.value = value;
+            m_Breakpoints.push_back(b);
+            fprintf(m_Out, "breakpoint %d at %03X\n",
+                (int)m_Breakpoints.size() - 1, addr);
+        }
+        else fprintf(m_Out, "usage: b ADDR [if vX OP NN]\n");
+    }
+    else if(strcmp(cmd, "w") == 0)
+    {
+        Watchpoint w;
+        unsigned int start, end;
+        int got = sscanf(rest, "%x %x", &start, &end);
+        if(got >= 1)
+        {
+            w.start = start;
+            w.end = (got == 2) ? end : start;
+            m_Watchpoints.push_back(w);
+            fprintf(m_Out, "watchpoint %d on %03X-%03X\n",
+                (int)(m_Breakpoints.size() + m_Watchpoints.size()) - 1,
+                w.start, w.end);
+        }
+        else fprintf(m_Out, "usage: w START [END]\n");
+    }
+    else if(strcmp(cmd, "d") == 0)
+    {
+        // breakpoints are numbered first, then watchpoints
+        int n = atoi(rest);
+        int numBreak = m_Breakpoints.size();
+        if(n >= 0 && n < numBreak)
+            m_Breakpoints.erase(m_Breakpoints.begin() + n);
+        else if(n >= numBreak && n < numBreak + (int)m_Watchpoints.size())
+            m_Watchpoints.erase(m_Watchpoints.begin() + (n - numBreak));
+        else fprintf(m_Out, "no breakpoint %d\n", n);
+    }
+    else if(strcmp(cmd, "l") == 0)
+    {
+        for(size_t i=0; i<m_Breakpoints.size(); i++)
+        {
+            Breakpoint &b = m_Breakpoints[i];
+            fprintf(m_Out, "%d: break %03X", (int)i, b.addr);
+            if(b.reg >= 0) fprintf(m_Out, " if v%X %s %X", b.reg, b.op.c_str(), b.value);
+            fprintf(m_Out, "\n");
+        }
+        for(size_t i=0; i<m_Watchpoints.size(); i++)
+        {
+            fprintf(m_Out, "%d: watch %03X-%03X\n",
+                (int)(m_Breakpoints.size() + i),
+                m_Watchpoints[i].start, m_Watchpoints[i].end);
+        }
+    }
+    else if(strcmp(cmd, "s") == 0)
+    {
+        m_Steps = rest[0] ? strtol(rest, NULL, 16) : 1;
+        if(m_Steps < 1) m_Steps = 1;
+        m_Stopped = false;
+        resume = true;
+    }
+    else if(strcmp(cmd, "c") == 0)
+    {
+        m_Stopped = false;
+        resume = true;
+    }
+    else if(strcmp(cmd, "p") == 0)
+    {
+        Stop("paused");
+    }
+    else if(strcmp(cmd, "r") == 0) ShowRegisters();
+    else if(strcmp(cmd, "k") == 0) ShowStack();
+    else if(strcmp(cmd, "x") == 0)
+    {
+        unsigned int addr, len = 16;
+        if(sscanf(rest, "%x %x", &addr, &len) >= 1) ShowMemory(addr, len);
+        else fprintf(m_Out, "usage: x ADDR [LEN]\n");
+    }
+    else if(strcmp(cmd, "q") == 0)
+    {
+        m_Quit = true;
+    }
+    else
+    {
+        fprintf(m_Out, "commands: b w d l s c p r k x q\n");
+    }
+
+    fflush(m_Out);
+    return resume;
+}
+
+/* Print the registers */
+void Debugger::ShowRegisters(void)
+{
+    for(int i=0; i<16; i++)
+        fprintf(m_Out, "V%X=%02X%s", i, m_Chip.m_Registers[i],
+            (i % 8 == 7) ? "\n" : " ");
+    fprintf(m_Out, "I=%03X PC=%03X DT=%02X ST=%02X\n", m_Chip.m_AddressI,
+        m_Chip.m_PC, m_Chip.DelayTimer(), m_Chip.SoundTimer());
+}
+
+/* Print the return addresses, innermost first */
+void Debugger::ShowStack(void)
+{
+    // entry 0 is the placeholder CPUReset() puts at the bottom
+    std::vector<WORD> &stack = m_Chip.m_Stack;
+    if(stack.size() <= 1) fprintf(m_Out, "stack is empty\n");
+    for(int i=stack.size()-1; i>=1; i--)
+        fprintf(m_Out, "#%d %03X\n", (int)stack.size()-1 - i, stack[i]);
+}
+
+/* Print memory as hex */
+void Debugger::ShowMemory(unsigned int addr, unsigned int len)
+{
+    if(addr >= sizeof(m_Chip.m_GameMemory))
+    {
+        fprintf(m_Out, "address %X is past the end of memory\n", addr);
+        return;
+    }
+
+    for(unsigned int i=0; i<len && addr+i < sizeof(m_Chip.m_GameMemory); i++)
+    {
+        if(i % 16 == 0) fprintf(m_Out, "%s%03X:", i ? "\n" : "", addr+i);
+        fprintf(m_Out, " %02X", m_Chip.m_GameMemory[addr+i]);
+    }
+    fprintf(m_Out, "\n");
+}
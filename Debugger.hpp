@@ -0,0 +1,107 @@
+/* Interactive debugger driven over stdin or a local socket */
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#ifndef DEBUGGER_H_INCLUDED
+#define DEBUGGER_H_INCLUDED
+
+// The debugger has its own execution loop (Run) which checks
+// breakpoints and watchpoints around every instruction. Frontends
+// call it instead of Chip8::RunNextInstruction() only while a
+// debugger is attached, so the normal loop pays nothing.
+//
+// commands are one per line, addresses and values are hex:
+//   b ADDR [if vX OP NN]   break at ADDR (OP: == != < > <= >=)
+//   w START [END]          stop after FX33/FX55 write into START-END
+//   d N                    delete breakpoint/watchpoint N
+//   l                      list breakpoints and watchpoints
+//   s [N]                  step N instructions (default 1)
+//   c                      continue
+//   p                      pause (while running)
+//   r                      show registers
+//   k                      show the stack
+//   x ADDR [LEN]           show memory
+//   q                      quit the emulator
+class Debugger
+{
+public:
+    // constructor/deconstructor
+    Debugger(Chip8 &chip);
+    ~Debugger(void);
+
+    // read commands from stdin and answer on stdout
+    bool OpenStdin(void);
+
+    // wait for one client on 127.0.0.1:port and talk to it
+    bool Listen(int port);
+
+    // run up to 'count' instructions. while stopped this waits for
+    // commands. returns false on an unhandled opcode, and stops early
+    // once 'q' is given
+    bool Run(int count);
+
+    // true after 'q': the emulator should exit
+    bool QuitRequested(void){return m_Quit;}
+
+private:
+    struct Breakpoint
+    {
+        WORD addr;
+        int  reg;     // -1 if unconditional
+        std::string op;
+        int  value;
+    };
+
+    struct Watchpoint
+    {
+        WORD start, end; // inclusive
+    };
+
+    // a breakpoint at the PC matches
+    int CheckBreakpoints(void);
+
+    // memory the next instruction writes (FX33/FX55), or false
+    bool WrittenRange(WORD &start, WORD &end);
+
+    // add the input that's there (or wait for some if 'block') to
+    // m_Pending. returns false if nothing came or the input closed
+    bool ReadInput(bool block);
+
+    // wait for a line. returns false if the input closed
+    bool ReadLine(std::string &line);
+
+    // take a "p" line out of the input if there is one
+    bool PauseRequested(void);
+
+    // run one command. returns true if execution should go on
+    bool Command(const std::string &line);
+
+    void Stop(const char *why);
+    void ShowRegisters(void);
+    void ShowStack(void);
+    void ShowMemory(unsigned int addr, unsigned int len);
+
+    Chip8 &m_Chip;
+
+    int   m_InFd;
+    FILE *m_Out;
+    int   m_ListenFd;
+    int   m_ClientFd;
+    std::string m_Pending;  // input read but not used yet
+    bool  m_Closed;         // no more input, just run
+    bool  m_Quit;           // 'q' was given
+
+    std::vector<Breakpoint> m_Breakpoints;
+    std::vector<Watchpoint> m_Watchpoints;
+
+    bool m_Stopped;
+    int  m_Steps;        // instructions left to step, 0 if not stepping
+    bool m_SkipBreak;    // don't stop again at the breakpoint we resume from
+};
+
+#endif // DEBUGGER_H_INCLUDED
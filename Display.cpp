@@ -1,11 +1,16 @@
 /* How to show graphics */
 
 #include "Display.hpp"
+#include "Keypad.hpp"
 
 /* Constructor */
 Display::Display(const int width, const int height, const char *title)
 {
     this->width = width; this->height = height;
+    m_Stretch = false;
+    m_Reset = false;
+    m_Redraw = true;
+    m_WinSurface = NULL;
     
     // Initialize SDL
     if(SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -14,17 +19,26 @@ Display::Display(const int width, const int height, const char *title)
         exit(EXIT_FAILURE);
     }
     
+    setVideoMode();
+    
+    // set the window title
+    SDL_WM_SetCaption(title, NULL);
+}
+
+/* Create the window, also when it's resized */
+void Display::setVideoMode(void)
+{
     // create the window
     // 8 is BPP - 8 bits per pixel
-    m_WinSurface = SDL_SetVideoMode(width, height, 8, SDL_OPENGL);
+    m_WinSurface = SDL_SetVideoMode(width, height, 8, SDL_OPENGL | SDL_RESIZABLE);
     if(!m_WinSurface)
     {
         fprintf(stderr, "Failed to create SDL window: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
     }
-    
-    // set the window title
-    SDL_WM_SetCaption(title, NULL);
+
+    m_Pixels.resize(width * height * 4);
+    m_Scaler.SetOutput(width, height, m_Stretch);
     
     // set opengl settings
     glViewport(0, 0, width, height);
@@ -58,16 +72,26 @@ Display::~Display(void)
     return true;
 }*/
 
+/* Pixel sizes that aren't whole numbers */
+void Display::setStretch(bool stretch)
+{
+    m_Stretch = stretch;
+    m_Scaler.SetOutput(width, height, m_Stretch);
+}
+
 /* Update screen and handle keys */
-void Display::update(unsigned char data[320][640][3])
+void Display::update(const uint64_t screen[32], const uint64_t *plane1)
 {
+    // only the rows that changed are redrawn into m_Pixels
+    m_Scaler.Scale(screen, plane1, &m_Pixels[0], width * 4);
+
     // opengl stuff
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
     glRasterPos2i(-1, 1);
     glPixelZoom(1, -1);
     
-    glDrawPixels(width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, &m_Pixels[0]);
     
     SDL_GL_SwapBuffers();
     
@@ -78,67 +102,73 @@ void Display::update(unsigned char data[320][640][3])
     // SDL_Delay(1000.0f/60.0f);
 }
 
-void Display::pollEvents(Chip8 &chip)
+bool Display::pollEvents(Chip8 &chip)
+{
+    WORD keys = 0;
+    for(int k=0; k<16; k++)
+        if(chip.m_Keys[k]) keys |= 1 << k;
+
+    bool running = pollEvents(keys);
+
+    for(int k=0; k<16; k++)
+        chip.SetKey(k, (keys >> k) & 1);
+    return running;
+}
+
+bool Display::pollEvents(WORD &keys)
 {
     // check keys
     SDL_Event e;
     while(SDL_PollEvent(&e))
     {
         // x out the window
-        if(e.type == SDL_QUIT) exit(EXIT_SUCCESS);
-        
-        // press keys
-        if(e.type == SDL_KEYDOWN)
+        if(e.type == SDL_QUIT) return false;
+
+        // the picture is fitted to the new size
+        if(e.type == SDL_VIDEORESIZE)
         {
-            switch(e.key.keysym.sym)
-            {
-                // exit the emulator
-                case SDLK_ESCAPE: exit(EXIT_SUCCESS);
-                
-                case SDLK_1: chip.SetKey(0x1, 1); break;
-                case SDLK_2: chip.SetKey(0x2, 1); break;
-                case SDLK_3: chip.SetKey(0x3, 1); break;
-                case SDLK_4: chip.SetKey(0xC, 1); break;
-                case SDLK_q: chip.SetKey(0x4, 1); break;
-                case SDLK_w: chip.SetKey(0x5, 1); break;
-                case SDLK_e: chip.SetKey(0x6, 1); break;
-                case SDLK_r: chip.SetKey(0xD, 1); break;
-                case SDLK_a: chip.SetKey(0x7, 1); break;
-                case SDLK_s: chip.SetKey(0x8, 1); break;
-                case SDLK_d: chip.SetKey(0x9, 1); break;
-                case SDLK_f: chip.SetKey(0xE, 1); break;
-                case SDLK_z: chip.SetKey(0xA, 1); break;
-                case SDLK_x: chip.SetKey(0x0, 1); break;
-                case SDLK_c: chip.SetKey(0xB, 1); break;
-                case SDLK_v: chip.SetKey(0xF, 1); break;
-                default:
-                    break;
-            }
+            width = e.resize.w;
+            height = e.resize.h;
+            setVideoMode();
+            m_Redraw = true;
+            continue;
         }
-        // release keys
-        else if(e.type == SDL_KEYUP)
+        if(e.type == SDL_VIDEOEXPOSE)
         {
-            switch(e.key.keysym.sym)
-            {
-                case SDLK_1: chip.SetKey(0x1, 0); break;
-                case SDLK_2: chip.SetKey(0x2, 0); break;
-                case SDLK_3: chip.SetKey(0x3, 0); break;
-                case SDLK_4: chip.SetKey(0xC, 0); break;
-                case SDLK_q: chip.SetKey(0x4, 0); break;
-                case SDLK_w: chip.SetKey(0x5, 0); break;
-                case SDLK_e: chip.SetKey(0x6, 0); break;
-                case SDLK_r: chip.SetKey(0xD, 0); break;
-                case SDLK_a: chip.SetKey(0x7, 0); break;
-                case SDLK_s: chip.SetKey(0x8, 0); break;
-                case SDLK_d: chip.SetKey(0x9, 0); break;
-                case SDLK_f: chip.SetKey(0xE, 0); break;
-                case SDLK_z: chip.SetKey(0xA, 0); break;
-                case SDLK_x: chip.SetKey(0x0, 0); break;
-                case SDLK_c: chip.SetKey(0xB, 0); break;
-                case SDLK_v: chip.SetKey(0xF, 0); break;
-                default:
-                    break;
-            }
+            m_Redraw = true;
+            continue;
         }
+        
+        if(e.type != SDL_KEYDOWN && e.type != SDL_KEYUP) continue;
+
+        // exit the emulator
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
+            return false;
+
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F5)
+            m_Reset = true;
+
+        // the same layout as the terminal frontend
+        int key = KeypadKey(e.key.keysym.sym);
+        if(key < 0) continue;
+
+        // press/release keys
+        if(e.type == SDL_KEYDOWN) keys |= 1 << key;
+        else                      keys &= ~(1 << key);
     }
+    return true;
+}
+
+bool Display::takeReset(void)
+{
+    bool reset = m_Reset;
+    m_Reset = false;
+    return reset;
+}
+
+bool Display::takeRedraw(void)
+{
+    bool redraw = m_Redraw;
+    m_Redraw = false;
+    return redraw;
 }
@@ -6,7 +6,10 @@
 
 #include <stdio.h>
 
+#include <vector>
+
 #include "Chip8.hpp"
+#include "Scaler.hpp"
 
 #ifndef DISPLAY_H_INCLUDED
 #define DISPLAY_H_INCLUDED
@@ -18,18 +21,46 @@ public:
     Display(const int width, const int height, const char *title);
     ~Display(void);
     
-    // clear screen
-    void update(unsigned char data[320][640][3]);
+    // draw the screen (Chip8::m_Screen) scaled to the window. 'plane1'
+    // is a second bitplane (see Scaler::Scale()), or NULL
+    void update(const uint64_t screen[32], const uint64_t *plane1);
+
+    // colors and effects
+    Scaler &scaler(void){return m_Scaler;}
+
+    // allow pixel sizes that aren't whole numbers when fitting the
+    // screen to the window
+    void setStretch(bool stretch);
     
-    // check keys
-    void pollEvents(Chip8 &chip);
+    // check keys. false once the window was closed or Esc pressed
+    bool pollEvents(Chip8 &chip);
+
+    // check keys, keeping them as a mask (bit N = key N) instead of
+    // setting them on a machine (used by netplay)
+    bool pollEvents(WORD &keys);
+
+    // true once after F5 was pressed (reset and load the ROM again)
+    bool takeReset(void);
+
+    // true once after the window was resized or uncovered, so the
+    // screen has to be drawn even if it hasn't changed
+    bool takeRedraw(void);
     
     // recreate the surface from the given array
     //bool updateSurface(unsigned char data[320][640][3]);
 private:
+    // (re)create the window at 'width' x 'height'
+    void setVideoMode(void);
+
     SDL_Surface *m_WinSurface;
     
     int width, height;
+    bool m_Stretch;
+    bool m_Reset;
+    bool m_Redraw;
+
+    Scaler m_Scaler;
+    std::vector<unsigned char> m_Pixels; // RGBA, the size of the window
 };
 
 #endif
@@ -0,0 +1,127 @@
+/* Waits for the start of each frame without burning the cpu */
+
+#include "FramePacer.hpp"
+#include "Timing.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const unsigned BUCKET_LIMITS[PACER_BUCKETS - 1] = {
+    10, 50, 100, 250, 500, 1000, 2000, 5000
+};
+
+/* sleep until 'when' (NowNanos time), or a bit longer */
+static void sleepUntil(uint64_t when)
+{
+#ifdef __WIN32
+    // no absolute sleeps here
+    uint64_t now = NowNanos();
+    if(when <= now) return;
+    struct timespec ts;
+    ts.tv_sec = (when - now) / 1000000000ULL;
+    ts.tv_nsec = (when - now) % 1000000000ULL;
+    nanosleep(&ts, NULL);
+#else
+    struct timespec ts;
+    ts.tv_sec = when / 1000000000ULL;
+    ts.tv_nsec = when % 1000000000ULL;
+
+    // signals interrupt it, the deadline stays the same. any other
+    // error would fail the same way every time, so don't spin on it
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+/* Constructor */
+FramePacer::FramePacer(void)
+{
+    m_Interval = 0;
+    m_Deadline = 0;
+    m_Oversleep = PACER_MIN_SPIN_NS;
+    memset(m_Histogram, 0, sizeof(m_Histogram));
+    m_Frames = 0;
+    m_MaxLate = 0;
+    m_Resyncs = 0;
+}
+
+/* Deconstructor */
+FramePacer::~FramePacer(void)
+{
+    if(m_Frames) PrintStats();
+}
+
+/* Set the schedule */
+void FramePacer::Start(uint64_t intervalNs)
+{
+    m_Interval = intervalNs;
+    m_Deadline = NowNanos();
+}
+
+/* Wait for the next frame */
+bool FramePacer::Wait(void)
+{
+    uint64_t now = NowNanos();
+
+    // sleep through most of it
+    uint64_t spin = m_Oversleep + PACER_MIN_SPIN_NS;
+    if(now + spin < m_Deadline)
+    {
+        uint64_t target = m_Deadline - spin;
+        sleepUntil(target);
+        now = NowNanos();
+
+        // follow the kernel's wake up latency: jump up to a late wake
+        // right away, come back down slowly
+        uint64_t late = now > target ? now - target : 0;
+        m_Oversleep -= m_Oversleep / 16;
+        if(late > m_Oversleep) m_Oversleep = late;
+        if(m_Oversleep > m_Interval / 4) m_Oversleep = m_Interval / 4;
+    }
+
+    // and spin the rest
+    while(now < m_Deadline) now = NowNanos();
+
+    uint64_t late = now - m_Deadline;
+    unsigned us = late / 1000;
+    int bucket = 0;
+    while(bucket < PACER_BUCKETS - 1 && us >= BUCKET_LIMITS[bucket]) bucket++;
+    m_Histogram[bucket]++;
+    m_Frames++;
+    if(late > m_MaxLate) m_MaxLate = late;
+
+    // stay on the schedule, unless it's so far behind that catching up
+    // would mean a burst of frames
+    m_Deadline += m_Interval;
+    if(now > m_Deadline + PACER_MAX_BEHIND * m_Interval)
+    {
+        m_Deadline = now + m_Interval;
+        m_Resyncs++;
+    }
+
+    return late >= m_Interval;
+}
+
+/* Print the histogram */
+void FramePacer::PrintStats(void)
+{
+    fprintf(stderr, "FramePacer: %llu frames, latest start %.3f ms late, "
+        "%llu restarts\n", (unsigned long long)m_Frames, m_MaxLate / 1e6,
+        (unsigned long long)m_Resyncs);
+
+    for(int i=0; i<PACER_BUCKETS; i++)
+    {
+        if(!m_Histogram[i]) continue;
+
+        char range[32];
+        if(i == PACER_BUCKETS - 1)
+            snprintf(range, sizeof(range), ">= %u us", BUCKET_LIMITS[i-1]);
+        else
+            snprintf(range, sizeof(range), "< %u us", BUCKET_LIMITS[i]);
+
+        fprintf(stderr, "  %-10s %10llu  %5.1f%%\n", range,
+            (unsigned long long)m_Histogram[i],
+            100.0 * m_Histogram[i] / m_Frames);
+    }
+}
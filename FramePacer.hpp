@@ -0,0 +1,56 @@
+/* Waits for the start of each frame without burning the cpu */
+
+#include <stdint.h>
+
+#ifndef FRAMEPACER_H_INCLUDED
+#define FRAMEPACER_H_INCLUDED
+
+// how late a frame may start (in frames) before the schedule gives up
+// catching up and starts over from now
+#define PACER_MAX_BEHIND 4
+
+// the spin before a deadline never gets shorter than this
+#define PACER_MIN_SPIN_NS 50000
+
+// the jitter histogram's buckets, upper bounds in microseconds (the
+// last bucket takes everything later)
+#define PACER_BUCKETS 9
+
+// Frames are due at fixed times from the start (start + n * interval),
+// so time spent working never adds up to drift. Wait() sleeps with
+// clock_nanosleep on the absolute time until shortly before the
+// deadline and spins the rest of the way. How early it wakes follows
+// how late the kernel has been waking it recently, so the spin is
+// normally well under a tenth of a millisecond.
+class FramePacer
+{
+public:
+    // constructor/deconstructor (prints the histogram if there is one)
+    FramePacer(void);
+    ~FramePacer(void);
+
+    // frames every 'intervalNs', the first one now
+    void Start(uint64_t intervalNs);
+
+    // wait until the next frame is due. returns true if it's already
+    // more than a frame late (the frame counts as dropped)
+    bool Wait(void);
+
+    // how late frames started, to stderr
+    void PrintStats(void);
+
+private:
+    uint64_t m_Interval;
+    uint64_t m_Deadline;    // when the next frame is due
+
+    // how late the last sleeps woke up, decaying
+    uint64_t m_Oversleep;
+
+    // lateness of frame starts, and how often the schedule restarted
+    uint64_t m_Histogram[PACER_BUCKETS];
+    uint64_t m_Frames;
+    uint64_t m_MaxLate;
+    uint64_t m_Resyncs;
+};
+
+#endif // FRAMEPACER_H_INCLUDED
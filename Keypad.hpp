@@ -0,0 +1,26 @@
+/* The keyboard layout used for the 16 key keypad */
+
+#ifndef KEYPAD_H_INCLUDED
+#define KEYPAD_H_INCLUDED
+
+//   keypad      keyboard
+//   1 2 3 C     1 2 3 4
+//   4 5 6 D     q w e r
+//   7 8 9 E     a s d f
+//   A 0 B F     z x c v
+
+/* The keypad key (0-F) for a character, -1 if it isn't one */
+inline int KeypadKey(int c)
+{
+    // indexed by keypad key
+    static const char layout[] = "x123qweasdzc4rfv";
+
+    if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    for(int k=0; k<16; k++)
+    {
+        if(layout[k] == c) return k;
+    }
+    return -1;
+}
+
+#endif // KEYPAD_H_INCLUDED
@@ -0,0 +1,323 @@
+/* Two player rollback netplay over UDP */
+
+#include "Netplay.hpp"
+#include "Timing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// no sockets in the Windows build: Open() says so and fails
+#ifndef __WIN32
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#endif
+
+#include <string>
+
+// packet layout (little endian):
+//   "C8NP", session, first frame, ack, count, count * keys
+#define NET_MAGIC       "C8NP"
+#define NET_HEADER_SIZE 17
+#define NET_MAX_SEND    (NET_HISTORY / 2)
+
+#define NET_STATES      (NET_ROLLBACK_FRAMES + 2)
+
+static void put32(BYTE *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get32(const BYTE *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Constructor */
+Netplay::Netplay(void)
+{
+    m_Fd = -1;
+    m_Session = 0;
+
+    m_Frame = 0;
+    m_RemoteFrames = 0;
+    m_PeerAck = 0;
+    m_Rollback = -1;
+
+    memset(m_Local, 0, sizeof(m_Local));
+    memset(m_Remote, 0, sizeof(m_Remote));
+    memset(m_Used, 0, sizeof(m_Used));
+
+    m_Rollbacks = 0;
+    m_ResimFrames = 0;
+    m_ResimNanos = 0;
+    m_MaxResimNanos = 0;
+    m_Stalls = 0;
+    m_Waiting = false;
+}
+
+/* Deconstructor */
+Netplay::~Netplay(void)
+{
+    Close();
+}
+
+/* Start a session */
+bool Netplay::Open(int localPort, const char *peer, Chip8 &chip)
+{
+#ifdef __WIN32
+    (void)localPort; (void)peer; (void)chip;
+    fprintf(stderr, "Netplay::Open: netplay isn't in the Windows build\n");
+    return false;
+#else
+    // split HOST:PORT
+    const char *colon = strrchr(peer, ':');
+    if(!colon)
+    {
+        fprintf(stderr, "Netplay::Open: peer '%s' should be HOST:PORT\n", peer);
+        return false;
+    }
+    std::string host(peer, colon - peer);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(host.c_str(), colon + 1, &hints, &res) != 0)
+    {
+        fprintf(stderr, "Netplay::Open: can't resolve '%s'\n", peer);
+        return false;
+    }
+    memcpy(&m_Peer, res->ai_addr, sizeof(m_Peer));
+    freeaddrinfo(res);
+
+    m_Fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(m_Fd < 0)
+    {
+        perror("Netplay::Open: socket");
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(localPort);
+    if(bind(m_Fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror("Netplay::Open: bind");
+        close(m_Fd);
+        m_Fd = -1;
+        return false;
+    }
+
+    // same ROM, quirks and clock give the same session, and the seed
+    // comes from it so CXNN agrees on both sides (FNV-1a)
+    std::vector<BYTE> state(Chip8::StateSize());
+    chip.SetSeed(1);
+    if(!chip.SaveState(&state[0]))
+    {
+        fprintf(stderr, "Netplay::Open: can't snapshot the machine\n");
+        close(m_Fd);
+        m_Fd = -1;
+        return false;
+    }
+
+    uint32_t h = 2166136261u;
+    for(size_t i=0; i<state.size(); i++)
+        h = (h ^ state[i]) * 16777619u;
+    for(const char *q = chip.GetQuirks(); *q; q++)
+        h = (h ^ (BYTE)*q) * 16777619u;
+    for(int i=0; i<4; i++)
+        h = (h ^ (BYTE)(chip.m_CyclesPerTick >> (i*8))) * 16777619u;
+    m_Session = h;
+    chip.SetSeed(m_Session);
+
+    for(int i=0; i<NET_STATES; i++)
+        m_States[i].resize(Chip8::StateSize());
+
+    fprintf(stderr, "Netplay: port %d, peer %s, session %08X\n",
+        localPort, peer, m_Session);
+
+    return true;
+#endif
+}
+
+/* End the session */
+void Netplay::Close(void)
+{
+    if(m_Fd < 0) return;
+
+    PrintStats();
+    close(m_Fd);
+    m_Fd = -1;
+}
+
+/* The remote keys for a frame */
+WORD Netplay::RemoteKeys(int frame)
+{
+    if(frame < m_RemoteFrames) return m_Remote[frame % NET_HISTORY];
+
+    // not here yet: assume nothing changed
+    if(m_RemoteFrames == 0) return 0;
+    return m_Remote[(m_RemoteFrames-1) % NET_HISTORY];
+}
+
+/* Run one frame with both players' keys */
+bool Netplay::Simulate(Chip8 &chip, int frame, int ops)
+{
+    WORD keys = m_Local[frame % NET_HISTORY] | m_Used[frame % NET_HISTORY];
+    for(int k=0; k<16; k++)
+        chip.SetKey(k, (keys >> k) & 1);
+
+    return chip.RunCycles(ops);
+}
+
+/* Advance the session by a frame */
+int Netplay::RunFrame(Chip8 &chip, WORD localKeys, int ops)
+{
+    Receive();
+
+    // a guess was wrong: go back and run up to now with the real keys
+    if(m_Rollback >= 0)
+    {
+        uint64_t start = NowNanos();
+
+        chip.LoadState(&m_States[m_Rollback % NET_STATES][0]);
+        for(int f = m_Rollback; f < m_Frame; f++)
+        {
+            if(f != m_Rollback && !SaveFrame(chip, f)) return -1;
+            m_Used[f % NET_HISTORY] = RemoteKeys(f);
+            if(!Simulate(chip, f, ops)) return -1;
+        }
+
+        uint64_t took = NowNanos() - start;
+        m_Rollbacks++;
+        m_ResimFrames += m_Frame - m_Rollback;
+        m_ResimNanos += took;
+        if(took > m_MaxResimNanos) m_MaxResimNanos = took;
+
+        m_Rollback = -1;
+    }
+
+    // too far ahead to roll back any further: wait for the peer
+    if(m_Frame - m_RemoteFrames >= NET_ROLLBACK_FRAMES)
+    {
+        if(m_RemoteFrames == 0 && !m_Waiting)
+            fprintf(stderr, "Netplay: waiting for the peer\n");
+        m_Waiting = true;
+        m_Stalls++;
+        Send();
+        return 0;
+    }
+    m_Local[m_Frame % NET_HISTORY] = localKeys;
+    if(!SaveFrame(chip, m_Frame)) return -1;
+    m_Used[m_Frame % NET_HISTORY] = RemoteKeys(m_Frame);
+    if(!Simulate(chip, m_Frame, ops)) return -1;
+    m_Frame++;
+
+    Send();
+    return 1;
+}
+
+/* Keep the machine as it is at the start of 'frame' */
+bool Netplay::SaveFrame(Chip8 &chip, int frame)
+{
+    // without it there's nothing to roll back to
+    if(!chip.SaveState(&m_States[frame % NET_STATES][0]))
+    {
+        fprintf(stderr, "Netplay: frame %d can't be saved (stack too deep), "
+            "ending the session\n", frame);
+        return false;
+    }
+    return true;
+}
+
+/* Send the local keys the peer hasn't confirmed */
+void Netplay::Send(void)
+{
+    int first = m_PeerAck;
+    if(first < m_Frame - NET_MAX_SEND) first = m_Frame - NET_MAX_SEND;
+    int count = m_Frame - first;
+
+    BYTE packet[NET_HEADER_SIZE + 2 * NET_MAX_SEND];
+    memcpy(packet, NET_MAGIC, 4);
+    put32(packet + 4, m_Session);
+    put32(packet + 8, first);
+    put32(packet + 12, m_RemoteFrames);
+    packet[16] = count;
+    for(int i=0; i<count; i++)
+    {
+        WORD keys = m_Local[(first + i) % NET_HISTORY];
+        packet[NET_HEADER_SIZE + 2*i]     = keys & 0xFF;
+        packet[NET_HEADER_SIZE + 2*i + 1] = keys >> 8;
+    }
+
+#ifndef __WIN32
+    sendto(m_Fd, packet, NET_HEADER_SIZE + 2*count, 0,
+        (struct sockaddr*)&m_Peer, sizeof(m_Peer));
+#endif
+}
+
+/* Take in everything that arrived */
+void Netplay::Receive(void)
+{
+#ifndef __WIN32
+    BYTE packet[512];
+    int len;
+    while((len = recv(m_Fd, packet, sizeof(packet), MSG_DONTWAIT)) > 0)
+    {
+        if(len < NET_HEADER_SIZE || memcmp(packet, NET_MAGIC, 4) != 0)
+            continue;
+        if(get32(packet + 4) != m_Session)
+        {
+            static bool warned = false;
+            if(!warned) fprintf(stderr, "Netplay: peer is running a different ROM, quirks or clock\n");
+            warned = true;
+            continue;
+        }
+
+        int first = get32(packet + 8);
+        int ack   = get32(packet + 12);
+        int count = packet[16];
+        if(len < NET_HEADER_SIZE + 2*count) continue;
+
+        if(ack > m_PeerAck && ack <= m_Frame) m_PeerAck = ack;
+
+        for(int i=0; i<count; i++)
+        {
+            int frame = first + i;
+            if(frame < m_RemoteFrames) continue;
+            // a gap (lost packets), or too far ahead to store
+            if(frame > m_RemoteFrames || frame >= m_Frame + NET_MAX_SEND) break;
+
+            WORD keys = packet[NET_HEADER_SIZE + 2*i] |
+                (packet[NET_HEADER_SIZE + 2*i + 1] << 8);
+            m_Remote[frame % NET_HISTORY] = keys;
+            m_RemoteFrames++;
+
+            // already run with a different guess
+            if(frame < m_Frame && m_Used[frame % NET_HISTORY] != keys &&
+                (m_Rollback < 0 || frame < m_Rollback))
+            {
+                m_Rollback = frame;
+            }
+        }
+    }
+#endif
+}
+
+/* How much rolling back happened */
+void Netplay::PrintStats(void)
+{
+    fprintf(stderr, "Netplay: %d frames, %llu rollbacks (%.1f%% of frames), "
+        "%llu frames re-run\n", m_Frame, (unsigned long long)m_Rollbacks,
+        m_Frame ? 100.0 * m_Rollbacks / m_Frame : 0.0,
+        (unsigned long long)m_ResimFrames);
+    fprintf(stderr, "Netplay: %.2f ms re-running (%.3f ms per rollback, "
+        "max %.3f ms), %llu frames stalled\n", m_ResimNanos / 1e6,
+        m_Rollbacks ? m_ResimNanos / 1e6 / m_Rollbacks : 0.0,
+        m_MaxResimNanos / 1e6, (unsigned long long)m_Stalls);
+}
@@ -0,0 +1,99 @@
+/* Two player rollback netplay over UDP */
+
+#include <stdint.h>
+
+#include <vector>
+
+#ifndef __WIN32
+#include <netinet/in.h>
+#endif
+
+#include "Chip8.hpp"
+
+#ifndef NETPLAY_H_INCLUDED
+#define NETPLAY_H_INCLUDED
+
+// how far (in frames) a side may run ahead of the inputs it has
+// confirmed from the other side. a late input older than this can't be
+// rolled back to, so the session stalls instead
+#define NET_ROLLBACK_FRAMES 8
+
+// inputs kept per side, must be well over 2 * NET_ROLLBACK_FRAMES
+#define NET_HISTORY 32
+
+// Both sides run the same machine and only exchange their keys, as a
+// 16 bit mask per frame; the game sees both players' keys or'ed
+// together. The remote keys for a frame that hasn't arrived yet are
+// guessed to be the last ones that did. When a guess turns out wrong
+// the machine goes back to the snapshot taken before that frame and
+// runs up to the present again with the real keys, all within the
+// current frame.
+//
+// every packet repeats the inputs the other side hasn't acknowledged
+// so lost packets need no resends.
+class Netplay
+{
+public:
+    // constructor/deconstructor
+    Netplay(void);
+    ~Netplay(void);
+
+    // listen on UDP 'localPort' and play against 'peer' ("HOST:PORT").
+    // both sides must have loaded the same ROM and quirk profile and set
+    // the same clock; the random seed is derived from them so the
+    // machines start identical
+    bool Open(int localPort, const char *peer, Chip8 &chip);
+    void Close(void);
+
+    bool IsOpen(void){return m_Fd >= 0;}
+
+    // run one frame ('ops' instructions) with the local keys. returns
+    // 1 if the frame ran, 0 if stalled waiting for the
+    // peer, -1 on an unhandled opcode
+    int RunFrame(Chip8 &chip, WORD localKeys, int ops);
+
+    // rollback statistics to stderr (also done by Close)
+    void PrintStats(void);
+
+private:
+    // run frame 'frame' from the current machine state
+    bool Simulate(Chip8 &chip, int frame, int ops);
+
+    // snapshot the machine for rolling back to 'frame'. false (and the
+    // session should end) if it can't be
+    bool SaveFrame(Chip8 &chip, int frame);
+
+    // the confirmed remote keys for a frame, or the latest ones
+    WORD RemoteKeys(int frame);
+
+    void Send(void);
+    void Receive(void);
+
+    int m_Fd;
+#ifndef __WIN32
+    struct sockaddr_in m_Peer;
+#endif
+    uint32_t m_Session;    // hash of the starting state, both sides agree
+
+    int m_Frame;           // next frame to run
+    int m_RemoteFrames;    // remote inputs confirmed for frames before this
+    int m_PeerAck;         // local inputs the peer has confirmed
+    int m_Rollback;        // earliest mispredicted frame, -1 if none
+
+    WORD m_Local[NET_HISTORY];
+    WORD m_Remote[NET_HISTORY];  // confirmed keys (frame < m_RemoteFrames)
+    WORD m_Used[NET_HISTORY];    // remote keys the last run of a frame used
+
+    // the state before each frame that might still be rolled back
+    std::vector<BYTE> m_States[NET_ROLLBACK_FRAMES + 2];
+
+    // statistics
+    uint64_t m_Rollbacks;
+    uint64_t m_ResimFrames;
+    uint64_t m_ResimNanos;
+    uint64_t m_MaxResimNanos;
+    uint64_t m_Stalls;
+    bool     m_Waiting;     // told the user the peer isn't there yet
+};
+
+#endif // NETPLAY_H_INCLUDED
@@ -2,18 +2,12 @@
 
 #include "Chip8.hpp"
 
+#include <cstring>
+
 /* 00E0: Clear Screen */
 void Chip8::m_Op00E0(Opcode op)
 {
-    for(int i=0; i<320; i++)
-    {
-        for(int j=0; j<640; j++)
-        {
-            m_ScreenData[i][j][0] = 255;
-            m_ScreenData[i][j][1] = 255;
-            m_ScreenData[i][j][2] = 255;
-        }
-    }
+    memset(m_Screen, 0, sizeof(m_Screen));
 }
 
 /* 00EE: return from subroutine (the previous PC
@@ -128,6 +122,7 @@ void Chip8::m_Op8XY0(Opcode op)
 }
 
 /* 8XY1: sets Vx to Vx | Vy */
+template<class Q>
 void Chip8::m_Op8XY1(Opcode op)
 {
     int regx = op.Num2();
@@ -135,9 +130,12 @@ void Chip8::m_Op8XY1(Opcode op)
     int regy = op.Num3();
     
     m_Registers[regx] = m_Registers[regx] | m_Registers[regy];
+
+    if(Q::LOGIC_RESETS_VF) m_Registers[0xF] = 0;
 }
 
 /* 8XY2: sets Vx to Vx & Vy (bit op) */
+template<class Q>
 void Chip8::m_Op8XY2(Opcode op)
 {
     int regx = op.Num2();
@@ -145,9 +143,12 @@ void Chip8::m_Op8XY2(Opcode op)
     int regy = op.Num3();
     
     m_Registers[regx] = m_Registers[regx] & m_Registers[regy];
+
+    if(Q::LOGIC_RESETS_VF) m_Registers[0xF] = 0;
 }
 
 /* 8XY3: sets Vx to Vx XOR Vy */
+template<class Q>
 void Chip8::m_Op8XY3(Opcode op)
 {
     int regx = op.Num2();
@@ -155,6 +156,8 @@ void Chip8::m_Op8XY3(Opcode op)
     int regy = op.Num3();
     
     m_Registers[regx] = m_Registers[regx] ^ m_Registers[regy];
+
+    if(Q::LOGIC_RESETS_VF) m_Registers[0xF] = 0;
 }
 
 /* 8XY4: Y is added to register X */
@@ -198,18 +201,21 @@ void Chip8::m_Op8XY5(Opcode op)
     m_Registers[regx] = m_Registers[regx] - m_Registers[regy];
 }
 
-/* 8XY6: shifts Vx right by 1
- * Flag is set to the LSB of Vx before the shift */
+/* 8XY6: shifts Vx (or Vy, depending on the quirks) right by 1
+ * into Vx. Flag is set to the LSB before the shift */
+template<class Q>
 void Chip8::m_Op8XY6(Opcode op)
 {
     int regx = op.Num2();
+    int regs = Q::SHIFT_USES_VY ? op.Num3() : regx; // shifted register
     
     // ex) 0b0011 & 1 = 1, 0b0010 & 1 = 0
-    int LSB = m_Registers[regx] & 1;
+    int LSB = m_Registers[regs] & 1;
+    int value = m_Registers[regs];
     m_Registers[0xF] = LSB;
     
-    // shift Vy by 1
-    m_Registers[regx] = m_Registers[regx] >> 1;
+    // shift by 1
+    m_Registers[regx] = value >> 1;
 }
 
 /* 8XY7: sets Vx to Vy - Vx, Vf set to 0 when borrow,
@@ -232,18 +238,21 @@ void Chip8::m_Op8XY7(Opcode op)
     m_Registers[regx] = m_Registers[regy] - m_Registers[regx];
 }
 
-/* 8XYE: shifts Vx left 1
- * flag set to MSB of Vx before shift */
+/* 8XYE: shifts Vx (or Vy, depending on the quirks) left 1
+ * into Vx. flag set to MSB before shift */
+template<class Q>
 void Chip8::m_Op8XYE(Opcode op)
 {
     int regx = op.Num2();
+    int regs = Q::SHIFT_USES_VY ? op.Num3() : regx; // shifted register
     
     // ex) 0b10110111 >> 7  = 1, 0b00001101 >> 7 = 0
-    int MSB = m_Registers[regx] >> 7;
+    int MSB = m_Registers[regs] >> 7;
+    int value = m_Registers[regs];
     m_Registers[0xF] = MSB;
     
     // left shift
-    m_Registers[regx] = m_Registers[regx] << 1;
+    m_Registers[regx] = value << 1;
 }
 
 /* 9XY0: skips next instruction if Vx != Vy */
@@ -268,29 +277,35 @@ void Chip8::m_OpANNN(Opcode op)
     m_AddressI = NNN;
 }
 
-/* BNNN: jumps to address NNN + V0 */
+/* BNNN: jumps to address NNN + V0
+ * (BXNN: XNN + Vx with the SCHIP quirks) */
+template<class Q>
 void Chip8::m_OpBNNN(Opcode op)
 {
-    m_PC = m_Registers[0x0] + op.Num234();
+    int reg = Q::JUMP_USES_VX ? op.Num2() : 0x0;
+
+    m_PC = m_Registers[reg] + op.Num234();
 }
 
-/* CXNN: sets Vx to rand() (usually 0-255) & NN */
+/* CXNN: sets Vx to Rand() (usually 0-255) & NN */
 void Chip8::m_OpCXNN(Opcode op)
 {
     int regx = op.Num2();
     
-    m_Registers[regx] = (rand()%255) & op.Num34();
+    m_Registers[regx] = (Rand()%255) & op.Num34();
 }
 
-/* DXYN - draw a sprite at coord (x,y) with a width of 8 and height of N */
+/* DXYN - draw a sprite at coord (x,y) with a width of 8 and height of N
+ * the start position wraps around the screen, the rest of the sprite
+ * is either clipped or wrapped depending on the quirks */
+template<class Q>
 void Chip8::m_OpDXYN(Opcode op)
 {
-    const int SCALE = 10; // Chip8 res 64 32, our res 640 320
     int regx = op.Num2();
     int regy = op.Num3();
     
-    int coordx = m_Registers[regx] * SCALE;
-    int coordy = m_Registers[regy] * SCALE;
+    int coordx = m_Registers[regx] % 64;
+    int coordy = m_Registers[regy] % 32;
     int height = op.Num4(); // no shift needed
     
     // set the flag to zero (no hit detected)
@@ -298,41 +313,25 @@ void Chip8::m_OpDXYN(Opcode op)
     
     for(int yline=0; yline < height; yline++)
     {
-        // m_AddressI contains sprite data stored as a line of bytes
-        BYTE data = m_GameMemory[m_AddressI + yline];
-        
-        int xpixel = 0;
-        int xpixelinv = 7; // xpixel inverted
-        for(xpixel=0; xpixel<8; xpixel++, xpixelinv--)
+        int py = coordy + yline;
+        if(py >= 32)
         {
-            // is the pixel set to 1? if so then the code needs to toggle its state
-            int mask = 1 << xpixelinv;
-            if(data & mask)
-            {
-                int x = (xpixel * SCALE) + coordx;
-                int y = (yline * SCALE) + coordy;
-                
-                int color = 0;
-                
-                // if collision detected
-                if(m_ScreenData[y][x][0] == 0)
-                {
-                    color = 255;
-                    m_Registers[0xF] = 1; // set collision flag
-                }
-                
-                // color the pixel
-                for(int i=0; i < SCALE; i++)
-                {
-                    for(int j=0; j < SCALE; j++)
-                    {
-                        m_ScreenData[y+i][x+j][0] = color;
-                        m_ScreenData[y+i][x+j][1] = color;
-                        m_ScreenData[y+i][x+j][2] = color;
-                    }
-                }
-            }
+            if(Q::CLIP_SPRITES) break;
+            py -= 32;
         }
+
+        // m_AddressI contains sprite data stored as a line of bytes,
+        // line it up with the screen row (bit 63 is x = 0)
+        uint64_t data = (uint64_t)m_GameMemory[m_AddressI + yline] << 56;
+        uint64_t mask = data >> coordx;
+
+        // the part past the right edge comes back in on the left
+        if(!Q::CLIP_SPRITES && coordx > 56)
+            mask |= data << (64 - coordx);
+
+        // toggle the pixels, any that were lit is a collision
+        if(m_Screen[py] & mask) m_Registers[0xF] = 1;
+        m_Screen[py] ^= mask;
     }
 }
 
@@ -368,7 +367,7 @@ void Chip8::m_OpFX07(Opcode op)
 {
     int regx = op.Num2();
     
-    m_Registers[regx] = m_DelayTimer;
+    m_Registers[regx] = DelayTimer();
 }
 
 /* FX0A: a key press is waited, and then stored in Vx
@@ -404,6 +403,7 @@ void Chip8::m_OpFX15(Opcode op)
     int regx = op.Num2();
     
     m_DelayTimer = m_Registers[regx];
+    m_DelaySetCycle = m_Cycles;
 }
 
 /* FX18: sets sound timer to Vx */
@@ -411,7 +411,9 @@ void Chip8::m_OpFX18(Opcode op)
 {
     int regx = op.Num2();
     
+    // the frontend watches SoundOn() to start and stop the beep
     m_SoundTimer = m_Registers[regx];
+    m_SoundSetCycle = m_Cycles;
 }
 
 /* FX1E: adds Vx to Address I */
@@ -448,10 +450,14 @@ void Chip8::m_OpFX33(Opcode op)
     m_GameMemory[m_AddressI+0] = hundreds;
     m_GameMemory[m_AddressI+1] = tens;
     m_GameMemory[m_AddressI+2] = units;
+
+    // self modifying code stops compiled blocks from running
+    InvalidateCode(m_AddressI, m_AddressI + 3);
 }
 
-/* Fx55: store V0 through Vx in memory starting at address I
- * author unsure if loop is  < or <= */
+/* Fx55: store V0 through Vx (including Vx) in memory starting at
+ * address I. I is moved past them unless the quirks say otherwise */
+template<class Q>
 void Chip8::m_OpFX55(Opcode op)
 {
     int regx = op.Num2();
@@ -460,11 +466,14 @@ void Chip8::m_OpFX55(Opcode op)
     {
         m_GameMemory[m_AddressI+i] = m_Registers[i];
     }
-    m_AddressI = m_AddressI + regx + 1;
+    InvalidateCode(m_AddressI, m_AddressI + regx + 1);
+    if(Q::LOADSTORE_INCREMENTS) m_AddressI = m_AddressI + regx + 1;
 }
 
 /* FX65: fills V0 to Vx (including Vx) with values from
- * memory starting at address I */
+ * memory starting at address I. I is moved past them unless the
+ * quirks say otherwise */
+template<class Q>
 void Chip8::m_OpFX65(Opcode op)
 {
     int regx = op.Num2();
@@ -473,5 +482,19 @@ void Chip8::m_OpFX65(Opcode op)
     {
         m_Registers[i] = m_GameMemory[m_AddressI+i];
     }
-    m_AddressI = m_AddressI + regx + 1;
-}
+    if(Q::LOADSTORE_INCREMENTS) m_AddressI = m_AddressI + regx + 1;
+}
+
+// build the quirk dependent handlers for every profile
+#define INSTANTIATE_HANDLERS(Q)                         \
+    template void Chip8::m_Op8XY1<Q>(Opcode op);        \
+    template void Chip8::m_Op8XY2<Q>(Opcode op);        \
+    template void Chip8::m_Op8XY3<Q>(Opcode op);        \
+    template void Chip8::m_Op8XY6<Q>(Opcode op);        \
+    template void Chip8::m_Op8XYE<Q>(Opcode op);        \
+    template void Chip8::m_OpBNNN<Q>(Opcode op);        \
+    template void Chip8::m_OpDXYN<Q>(Opcode op);        \
+    template void Chip8::m_OpFX55<Q>(Opcode op);        \
+    template void Chip8::m_OpFX65<Q>(Opcode op);
+CHIP8_QUIRK_PROFILES(INSTANTIATE_HANDLERS)
+#undef INSTANTIATE_HANDLERS
@@ -0,0 +1,182 @@
+/* Counts instructions per guest subroutine and call stack */
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <map>
+
+/* Constructor */
+Profiler::Profiler(void)
+{
+    Reset();
+}
+
+/* Deconstructor */
+Profiler::~Profiler(void)
+{
+    Close();
+}
+
+/* Start over with just the root */
+void Profiler::Reset(void)
+{
+    Node root = { 0, 0x200, 0, 0, 0, 0, 0 };
+    m_Nodes.assign(1, root);
+    m_Children.clear();
+    m_Cur = 0;
+    m_Depth = 0;
+}
+
+/* Write the results */
+void Profiler::Close(void)
+{
+    if(m_File.empty()) return;
+
+    if(WriteFolded(m_File.c_str()))
+        fprintf(stderr, "Profiler: wrote '%s'\n", m_File.c_str());
+    PrintTable(stderr);
+    m_File.clear();
+}
+
+/* Find or add a node */
+uint32_t Profiler::Child(uint32_t parent, uint16_t addr)
+{
+    uint32_t last = m_Nodes[parent].lastChild;
+    if(last && m_Nodes[last].addr == addr) return last;
+
+    uint64_t key = ((uint64_t)parent << 16) | addr;
+    std::unordered_map<uint64_t, uint32_t>::iterator it = m_Children.find(key);
+    if(it != m_Children.end())
+    {
+        m_Nodes[parent].lastChild = it->second;
+        return it->second;
+    }
+
+    Node n = { parent, addr, (uint16_t)(m_Nodes[parent].depth + 1), 0, 0, 0, 0 };
+    m_Nodes.push_back(n);
+    m_Children[key] = m_Nodes.size() - 1;
+    m_Nodes[parent].lastChild = m_Nodes.size() - 1;
+    return m_Nodes.size() - 1;
+}
+
+/* Follow a call, return or anything else that changed the stack */
+void Profiler::Follow(uint16_t opcode, unsigned depth)
+{
+    // the usual case, a call
+    if(depth == m_Depth + 1 && (opcode & 0xF000) == 0x2000)
+    {
+        m_Depth = depth;
+        if(m_Nodes[m_Cur].depth < PROFILE_MAX_DEPTH)
+        {
+            m_Cur = Child(m_Cur, opcode & 0x0FFF);
+            m_Nodes[m_Cur].calls++;
+        }
+        return;
+    }
+
+    // returns, and stacks that changed some other way: unwind to the
+    // new depth, filling in frames that weren't seen being called
+    m_Depth = depth;
+    unsigned keep = std::min(depth, (unsigned)PROFILE_MAX_DEPTH);
+    while(m_Nodes[m_Cur].depth > keep) m_Cur = m_Nodes[m_Cur].parent;
+    while(m_Nodes[m_Cur].depth < keep) m_Cur = Child(m_Cur, PROFILE_UNKNOWN);
+}
+
+/* name of one frame */
+static std::string frameName(uint16_t addr, bool root)
+{
+    if(root) return "main";
+    if(addr == PROFILE_UNKNOWN) return "?";
+
+    char name[16];
+    snprintf(name, sizeof(name), "sub_%03X", addr);
+    return name;
+}
+
+/* Join the frames from the root down */
+std::string Profiler::StackName(uint32_t node)
+{
+    std::string name = frameName(m_Nodes[node].addr, node == 0);
+    while(node != 0)
+    {
+        node = m_Nodes[node].parent;
+        name = frameName(m_Nodes[node].addr, node == 0) + ";" + name;
+    }
+    return name;
+}
+
+/* Write the folded stacks */
+bool Profiler::WriteFolded(const char *fname)
+{
+    FILE *fp = fopen(fname, "w");
+    if(!fp)
+    {
+        fprintf(stderr, "Profiler::WriteFolded: Failed to open '%s'\n", fname);
+        return false;
+    }
+
+    for(size_t i=0; i<m_Nodes.size(); i++)
+    {
+        if(!m_Nodes[i].instructions) continue;
+        fprintf(fp, "%s %llu\n", StackName(i).c_str(),
+            (unsigned long long)m_Nodes[i].instructions);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/* Print the totals per subroutine */
+void Profiler::PrintTable(FILE *fp)
+{
+    struct Totals
+    {
+        uint64_t self, total, draws, calls;
+    };
+
+    // a node's own counts go to its subroutine, and to the total of
+    // every subroutine on its stack (once each, for recursion)
+    std::map<uint32_t, Totals> subs;
+    uint64_t all = 0;
+    for(size_t i=0; i<m_Nodes.size(); i++)
+    {
+        const Node &n = m_Nodes[i];
+        uint32_t key = i == 0 ? 0 : n.addr;
+        Totals &t = subs[key];
+        t.self += n.instructions;
+        t.draws += n.draws;
+        t.calls += n.calls;
+        all += n.instructions;
+
+        if(!n.instructions) continue;
+
+        std::vector<uint32_t> seen;
+        for(uint32_t node = i; ; node = m_Nodes[node].parent)
+        {
+            uint32_t k = node == 0 ? 0 : m_Nodes[node].addr;
+            if(std::find(seen.begin(), seen.end(), k) == seen.end())
+            {
+                seen.push_back(k);
+                subs[k].total += n.instructions;
+            }
+            if(node == 0) break;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t> > order;
+    for(std::map<uint32_t, Totals>::iterator it = subs.begin(); it != subs.end(); ++it)
+        order.push_back(std::make_pair(it->second.self, it->first));
+    std::sort(order.rbegin(), order.rend());
+
+    fprintf(fp, "%-10s %12s %6s %12s %10s %10s\n", "subroutine", "self",
+        "self%", "total", "calls", "draws");
+    for(size_t i=0; i<order.size(); i++)
+    {
+        const Totals &t = subs[order[i].second];
+        fprintf(fp, "%-10s %12llu %5.1f%% %12llu %10llu %10llu\n",
+            frameName(order[i].second, order[i].second == 0).c_str(),
+            (unsigned long long)t.self, all ? 100.0 * t.self / all : 0.0,
+            (unsigned long long)t.total, (unsigned long long)t.calls,
+            (unsigned long long)t.draws);
+    }
+}
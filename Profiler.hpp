@@ -0,0 +1,90 @@
+/* Counts instructions per guest subroutine and call stack */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+// deeper calls are counted in the deepest frame that is kept
+#define PROFILE_MAX_DEPTH 64
+
+// a frame entered some other way than a 2NNN that was seen (a snapshot
+// was loaded, or the profiler was attached mid call)
+#define PROFILE_UNKNOWN 0xFFFF
+
+// Exact, not sampled: every instruction is counted in the node of a
+// call tree (one node per distinct call stack). Calls and returns are
+// seen as changes in the depth of Chip8::m_Stack, so the profiler
+// never gets out of step with the guest, and all the per-instruction
+// work is two increments and a compare; the tree is only searched when
+// the depth changes.
+class Profiler
+{
+public:
+    // constructor/deconstructor (the deconstructor calls Close())
+    Profiler(void);
+    ~Profiler(void);
+
+    // Close() writes folded stacks ("main;sub_2A4;sub_31C 1234", for
+    // flamegraph.pl and similar) to 'fname' and prints the table of
+    // subroutines to stderr
+    void WriteOnClose(const char *fname){m_File = fname;}
+    void Close(void);
+
+    // count one executed instruction. 'depth' is the guest stack depth
+    // after it ran (calls made, not counting the bottom entry)
+    void Step(uint16_t opcode, unsigned depth)
+    {
+        Node &n = m_Nodes[m_Cur];
+        n.instructions++;
+        if((opcode & 0xF000) == 0xD000) n.draws++;
+        if(depth != m_Depth) Follow(opcode, depth);
+    }
+
+    // write the folded stacks, false if the file can't be written
+    bool WriteFolded(const char *fname);
+
+    // per subroutine totals, slowest first
+    void PrintTable(FILE *fp);
+
+    // forget everything counted so far
+    void Reset(void);
+
+private:
+    // one distinct call stack
+    struct Node
+    {
+        uint32_t parent;
+        uint16_t addr;         // the subroutine, 0x200 for the root
+        uint16_t depth;
+        uint64_t instructions; // run in this subroutine itself
+        uint64_t draws;        // DXYN of them
+        uint64_t calls;
+
+        // the last call made from here, most calls repeat it
+        uint32_t lastChild;
+    };
+
+    // the stack depth changed: move to the matching node
+    void Follow(uint16_t opcode, unsigned depth);
+
+    // the node for calling 'addr' from 'parent'
+    uint32_t Child(uint32_t parent, uint16_t addr);
+
+    // "main;sub_2A4;sub_31C" for a node
+    std::string StackName(uint32_t node);
+
+    std::vector<Node> m_Nodes;
+    std::unordered_map<uint64_t, uint32_t> m_Children; // (parent, addr)
+    uint32_t m_Cur;
+    unsigned m_Depth;   // the guest's, may be past PROFILE_MAX_DEPTH
+
+    std::string m_File;
+};
+
+#endif // PROFILER_H_INCLUDED
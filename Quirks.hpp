@@ -0,0 +1,59 @@
+/* Behaviours that differ between CHIP-8 variants */
+
+#ifndef QUIRKS_H_INCLUDED
+#define QUIRKS_H_INCLUDED
+
+// Each profile is a type the interpreter is built with (see
+// Chip8::ExecuteNextInstruction), so the checks below are constants
+// in the handlers and cost nothing at runtime.
+//
+//  SHIFT_USES_VY        8XY6/8XYE shift Vy into Vx instead of Vx itself
+//  LOADSTORE_INCREMENTS FX55/FX65 leave I pointing past the last register
+//  JUMP_USES_VX         BXNN jumps to XNN + Vx instead of BNNN to NNN + V0
+//  LOGIC_RESETS_VF      8XY1/8XY2/8XY3 set VF to 0
+//  CLIP_SPRITES         DXYN cuts sprites off at the screen edge
+//                       instead of wrapping them around
+
+/* what this emulator has always done */
+struct QuirksLegacy
+{
+    static const bool SHIFT_USES_VY        = false;
+    static const bool LOADSTORE_INCREMENTS = true;
+    static const bool JUMP_USES_VX         = false;
+    static const bool LOGIC_RESETS_VF      = false;
+    static const bool CLIP_SPRITES         = false;
+
+    static const char *Name(void){return "legacy";}
+};
+
+/* the original COSMAC VIP interpreter */
+struct QuirksVIP
+{
+    static const bool SHIFT_USES_VY        = true;
+    static const bool LOADSTORE_INCREMENTS = true;
+    static const bool JUMP_USES_VX         = false;
+    static const bool LOGIC_RESETS_VF      = true;
+    static const bool CLIP_SPRITES         = true;
+
+    static const char *Name(void){return "vip";}
+};
+
+/* CHIP-48 / SUPER-CHIP on the HP48 */
+struct QuirksSCHIP
+{
+    static const bool SHIFT_USES_VY        = false;
+    static const bool LOADSTORE_INCREMENTS = false;
+    static const bool JUMP_USES_VX         = true;
+    static const bool LOGIC_RESETS_VF      = false;
+    static const bool CLIP_SPRITES         = true;
+
+    static const char *Name(void){return "schip";}
+};
+
+// every profile, so each one gets its own build of the interpreter
+#define CHIP8_QUIRK_PROFILES(X) \
+    X(QuirksLegacy)             \
+    X(QuirksVIP)                \
+    X(QuirksSCHIP)
+
+#endif // QUIRKS_H_INCLUDED
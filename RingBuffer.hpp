@@ -0,0 +1,66 @@
+/* Single producer/single consumer lock-free ring buffer */
+
+#include <atomic>
+#include <cstddef>
+
+#ifndef RINGBUFFER_H_INCLUDED
+#define RINGBUFFER_H_INCLUDED
+
+// SIZE must be a power of two. One thread may call push() and
+// one other thread may call pop()/peek() at the same time without locks
+template<class T, unsigned int SIZE>
+class RingBuffer
+{
+public:
+    RingBuffer(void) : m_Head(0), m_Tail(0) {}
+
+    // returns false (and drops the item) if the buffer is full,
+    // so the producer never waits on the consumer
+    bool push(const T &item)
+    {
+        unsigned int head = m_Head.load(std::memory_order_relaxed);
+        unsigned int tail = m_Tail.load(std::memory_order_acquire);
+        if(head - tail == SIZE) return false;
+
+        m_Items[head & (SIZE-1)] = item;
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // look at the oldest item without removing it
+    bool peek(T &item)
+    {
+        unsigned int tail = m_Tail.load(std::memory_order_relaxed);
+        unsigned int head = m_Head.load(std::memory_order_acquire);
+        if(head == tail) return false;
+
+        item = m_Items[tail & (SIZE-1)];
+        return true;
+    }
+
+    // remove the oldest item
+    bool pop(T &item)
+    {
+        if(!peek(item)) return false;
+        m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+        return true;
+    }
+
+    // number of items waiting (approximate while the other side runs)
+    unsigned int size(void)
+    {
+        return m_Head.load(std::memory_order_acquire) -
+               m_Tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_Items[SIZE];
+
+    // head and tail on their own cache lines so the two threads
+    // don't fight over the same line
+    alignas(64) std::atomic<unsigned int> m_Head; // written by producer
+    alignas(64) std::atomic<unsigned int> m_Tail; // written by consumer
+};
+
+#endif // RINGBUFFER_H_INCLUDED
@@ -0,0 +1,190 @@
+/* Reloads the ROM into a running machine when the file changes */
+
+#include "RomWatcher.hpp"
+#include "Timing.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// the most a ROM can be (memory after 0x200)
+#define ROMWATCH_MAX_SIZE (0xFFF - 0x200)
+
+/* Constructor */
+RomWatcher::RomWatcher(void)
+{
+    m_Fd = -1;
+    m_Open = false;
+    m_MTime = 0;
+    m_Countdown = 0;
+}
+
+/* Deconstructor */
+RomWatcher::~RomWatcher(void)
+{
+    Close();
+}
+
+/* modification time of a file, 0 if it isn't there */
+static long fileTime(const char *fname)
+{
+    struct stat st;
+    if(stat(fname, &st) != 0) return 0;
+    return (long)st.st_mtime;
+}
+
+/* Start watching */
+bool RomWatcher::Open(const char *fname)
+{
+    m_File = fname;
+
+    const char *slash = strrchr(fname, '/');
+    std::string dir = slash ? std::string(fname, slash - fname + 1) : "./";
+    m_Name = slash ? slash + 1 : fname;
+
+    if(!ReadFile(m_Image))
+    {
+        fprintf(stderr, "RomWatcher::Open: Failed to read '%s'\n", fname);
+        return false;
+    }
+
+#ifdef __linux__
+    // the directory, since build tools often replace the file. only
+    // finished files: a created one may still be empty or half written
+    m_Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_Fd >= 0 && inotify_add_watch(m_Fd, dir.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(m_Fd);
+        m_Fd = -1;
+    }
+#endif
+    if(m_Fd < 0) m_MTime = fileTime(fname);
+
+    m_Open = true;
+    return true;
+}
+
+/* Stop watching */
+void RomWatcher::Close(void)
+{
+    if(m_Fd >= 0) close(m_Fd);
+    m_Fd = -1;
+    m_Open = false;
+}
+
+/* Read the file */
+bool RomWatcher::ReadFile(std::vector<BYTE> &data)
+{
+    FILE *fp = fopen(m_File.c_str(), "rb");
+    if(!fp) return false;
+
+    data.resize(ROMWATCH_MAX_SIZE + 1);
+    int size = fread(&data[0], 1, data.size(), fp);
+    fclose(fp);
+
+    if(size > ROMWATCH_MAX_SIZE)
+    {
+        fprintf(stderr, "RomWatcher: '%s' is too big, not reloaded\n",
+            m_File.c_str());
+        return false;
+    }
+    data.resize(size);
+    return true;
+}
+
+/* Check for changes */
+bool RomWatcher::Poll(Chip8 &chip)
+{
+    if(!m_Open) return false;
+
+    bool changed = false;
+
+#ifdef __linux__
+    if(m_Fd >= 0)
+    {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while((len = read(m_Fd, buf, sizeof(buf))) > 0)
+        {
+            for(char *p = buf; p < buf + len; )
+            {
+                struct inotify_event *e = (struct inotify_event*)p;
+                if(e->len && m_Name == e->name) changed = true;
+                p += sizeof(struct inotify_event) + e->len;
+            }
+        }
+    }
+#endif
+
+    // no inotify: look at the time now and then
+    if(m_Fd < 0 && --m_Countdown <= 0)
+    {
+        m_Countdown = ROMWATCH_POLL_FRAMES;
+        long t = fileTime(m_File.c_str());
+        if(t != m_MTime)
+        {
+            m_MTime = t;
+            changed = true;
+        }
+    }
+
+    if(!changed) return false;
+
+    // an empty file is a build in the middle of writing it
+    std::vector<BYTE> data;
+    if(!ReadFile(data) || data.empty())
+    {
+        // polling tries again next time, inotify waits for the close
+        m_MTime = 0;
+        return false;
+    }
+
+    Patch(chip, data);
+    return true;
+}
+
+/* Copy in the ranges that differ */
+void RomWatcher::Patch(Chip8 &chip, const std::vector<BYTE> &data)
+{
+    uint64_t start = NowNanos();
+
+    // a shorter ROM leaves zeros behind, like a fresh load would
+    std::vector<BYTE> next(data);
+    if(next.size() < m_Image.size()) next.resize(m_Image.size(), 0);
+    m_Image.resize(next.size(), 0);
+
+    int bytes = 0, ranges = 0;
+    for(size_t i=0; i<next.size(); )
+    {
+        if(next[i] == m_Image[i]) {
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        while(end < next.size() && next[end] != m_Image[end]) end++;
+
+        chip.PatchROM(i, &next[i], end - i);
+        bytes += end - i;
+        ranges++;
+        i = end;
+    }
+
+    m_Image = data;
+
+    fprintf(stderr, "RomWatcher: reloaded '%s', %d bytes changed in %d "
+        "ranges (%.3f ms)\n", m_File.c_str(), bytes, ranges,
+        (NowNanos() - start) / 1e6);
+}
+
+/* After a full reload */
+void RomWatcher::Reloaded(void)
+{
+    if(m_Open) ReadFile(m_Image);
+}
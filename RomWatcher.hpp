@@ -0,0 +1,56 @@
+/* Reloads the ROM into a running machine when the file changes */
+
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#ifndef ROMWATCHER_H_INCLUDED
+#define ROMWATCHER_H_INCLUDED
+
+// without inotify the file's time is checked this often (in Poll calls)
+#define ROMWATCH_POLL_FRAMES 30
+
+// Watches the ROM's directory with inotify, so files that are replaced
+// (written elsewhere and renamed over it) are seen as well. A changed
+// file is compared against the last version byte by byte and only the
+// ranges that differ are patched into memory; registers, stack, timers
+// and screen carry on as they were.
+class RomWatcher
+{
+public:
+    // constructor/deconstructor
+    RomWatcher(void);
+    ~RomWatcher(void);
+
+    // start watching 'fname', which is what's loaded at the moment
+    bool Open(const char *fname);
+    void Close(void);
+
+    // patch 'chip' if the file changed since the last call. returns
+    // true if anything was reloaded
+    bool Poll(Chip8 &chip);
+
+    // the ROM was loaded again from scratch (a reset)
+    void Reloaded(void);
+
+private:
+    // read the whole file, false if it can't be read (yet)
+    bool ReadFile(std::vector<BYTE> &data);
+
+    // bring memory in line with the file
+    void Patch(Chip8 &chip, const std::vector<BYTE> &data);
+
+    std::string m_File;
+    std::string m_Name;        // without the directory
+    std::vector<BYTE> m_Image; // the version in memory
+
+    int m_Fd;                  // inotify, -1 if not in use
+    bool m_Open;
+
+    // used without inotify
+    long m_MTime;
+    int  m_Countdown;
+};
+
+#endif // ROMWATCHER_H_INCLUDED
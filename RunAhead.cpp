@@ -0,0 +1,86 @@
+/* Shows frames from a little in the future to hide input lag */
+
+#include "RunAhead.hpp"
+#include "Timing.hpp"
+
+#include <string.h>
+
+/* Constructor */
+RunAhead::RunAhead(void)
+{
+    m_Frames = 0;
+    m_State.resize(Chip8::StateSize());
+    memset(m_Screen, 0, sizeof(m_Screen));
+
+    m_Runs = 0;
+    m_TotalNs = 0;
+    m_MaxNs = 0;
+    m_Budget = 0;
+    m_OverHalf = 0;
+    m_Failed = 0;
+}
+
+/* Deconstructor */
+RunAhead::~RunAhead(void)
+{
+    if(m_Runs) PrintStats();
+}
+
+/* Set how far to look ahead */
+void RunAhead::SetFrames(int frames)
+{
+    m_Frames = frames < 0 ? 0 : frames > RUNAHEAD_MAX ? RUNAHEAD_MAX : frames;
+}
+
+/* Run the hidden frames */
+const uint64_t *RunAhead::Run(Chip8 &chip, int ops, uint64_t budget)
+{
+    if(m_Frames == 0) return chip.m_Screen;
+
+    uint64_t start = NowNanos();
+
+    // a stack too deep for a snapshot: just show the real frame
+    if(!chip.SaveState(&m_State[0]))
+    {
+        m_Failed++;
+        return chip.m_Screen;
+    }
+
+    // the hidden frames mustn't show up in a trace or profile
+    Tracer *tracer = chip.m_Tracer;
+    Profiler *profiler = chip.m_Profiler;
+    if(tracer) chip.AttachTracer(NULL);
+    if(profiler) chip.AttachProfiler(NULL);
+
+    bool ok = true;
+    for(int f=0; f<m_Frames && ok; f++)
+        ok = chip.RunCycles(ops);
+
+    // a crash in the future is left for the real frames to find
+    if(ok) memcpy(m_Screen, chip.m_Screen, sizeof(m_Screen));
+    else   m_Failed++;
+
+    chip.LoadState(&m_State[0]);
+    if(tracer) chip.AttachTracer(tracer);
+    if(profiler) chip.AttachProfiler(profiler);
+
+    uint64_t took = NowNanos() - start;
+    m_Runs++;
+    m_TotalNs += took;
+    if(took > m_MaxNs) m_MaxNs = took;
+    if(took * 2 > budget) m_OverHalf++;
+    m_Budget = budget;
+
+    return ok ? m_Screen : chip.m_Screen;
+}
+
+/* Print the timing */
+void RunAhead::PrintStats(void)
+{
+    double avg = (double)m_TotalNs / m_Runs;
+    fprintf(stderr, "RunAhead: %d frames ahead, %llu runs, average %.3f ms "
+        "(%.1f%% of a frame), slowest %.3f ms, %llu over half a frame, "
+        "%llu failed\n", m_Frames, (unsigned long long)m_Runs, avg / 1e6,
+        m_Budget ? 100.0 * avg / m_Budget : 0.0, m_MaxNs / 1e6,
+        (unsigned long long)m_OverHalf, (unsigned long long)m_Failed);
+}
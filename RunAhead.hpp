@@ -0,0 +1,51 @@
+/* Shows frames from a little in the future to hide input lag */
+
+#include <vector>
+
+#include "Chip8.hpp"
+
+#ifndef RUNAHEAD_H_INCLUDED
+#define RUNAHEAD_H_INCLUDED
+
+// most frames that can be run ahead
+#define RUNAHEAD_MAX 8
+
+// Games usually react to a key a frame or more after it's pressed.
+// After each real frame the machine is saved, run 'frames' more frames
+// with the keys as they are now, and its screen is kept for showing;
+// then the save is loaded back, so the hidden frames never happened.
+// Tracers and profilers are detached while they run.
+class RunAhead
+{
+public:
+    // constructor/deconstructor (prints the timing if it ran)
+    RunAhead(void);
+    ~RunAhead(void);
+
+    // how many frames ahead, 0 is off
+    void SetFrames(int frames);
+    int  Frames(void){return m_Frames;}
+
+    // run ahead from 'chip' (then put it back as it was) and return
+    // the screen to show. 'ops' is instructions per frame, 'budget'
+    // the time a frame has in nanoseconds (for the report)
+    const uint64_t *Run(Chip8 &chip, int ops, uint64_t budget);
+
+    // time taken, to stderr
+    void PrintStats(void);
+
+private:
+    int m_Frames;
+    std::vector<BYTE> m_State;
+    uint64_t m_Screen[32];
+
+    // timing of the hidden frames
+    uint64_t m_Runs;
+    uint64_t m_TotalNs;
+    uint64_t m_MaxNs;
+    uint64_t m_Budget;
+    uint64_t m_OverHalf;   // runs that took over half the frame
+    uint64_t m_Failed;     // couldn't be saved or ran into a bad opcode
+};
+
+#endif // RUNAHEAD_H_INCLUDED
@@ -0,0 +1,274 @@
+/* Turns the 1 bit screen into RGBA pixels for a window of any size */
+
+#include "Scaler.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCALER_X86
+#endif
+
+struct NamedPalette
+{
+    const char *name;
+    uint32_t colors[4];
+};
+
+static const NamedPalette PALETTES[] = {
+    { "classic", { 0xFFFFFF, 0x000000, 0xAAAAAA, 0x555555 } },
+    { "green",   { 0x0A1A0A, 0x33FF66, 0x1E9940, 0x99FFBB } },
+    { "amber",   { 0x1A0F00, 0xFFB000, 0x996A00, 0xFFD880 } },
+    { "lcd",     { 0x9BBC0F, 0x0F380F, 0x8BAC0F, 0x306230 } },
+};
+
+/* 0xRRGGBB to RGBA bytes in memory */
+static uint32_t toRGBA(uint32_t rgb)
+{
+    const uint8_t bytes[4] = { (uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8),
+        (uint8_t)rgb, 255 };
+    uint32_t v;
+    memcpy(&v, bytes, 4);
+    return v;
+}
+
+#ifndef SCALER_X86
+/* fill the runs of one output row, plain C++ */
+static void fillPlain(uint32_t *row, const Scaler::Run *runs, int count,
+    const uint32_t *colors)
+{
+    for(int r=0; r<count; r++)
+        std::fill(row + runs[r].start, row + runs[r].start + runs[r].length,
+            colors[runs[r].color]);
+}
+#else
+/* fill the runs of one output row, 4 pixels per store */
+static void fillSSE2(uint32_t *row, const Scaler::Run *runs, int count,
+    const uint32_t *colors)
+{
+    for(int r=0; r<count; r++)
+    {
+        uint32_t color = colors[runs[r].color];
+        __m128i v = _mm_set1_epi32(color);
+        uint32_t *p = row + runs[r].start;
+        int n = runs[r].length;
+
+        for(; n >= 4; n -= 4, p += 4) _mm_storeu_si128((__m128i*)p, v);
+        for(; n > 0; n--) *p++ = color;
+    }
+}
+
+/* fill the runs of one output row, 8 pixels per store */
+__attribute__((target("avx2")))
+static void fillAVX2(uint32_t *row, const Scaler::Run *runs, int count,
+    const uint32_t *colors)
+{
+    for(int r=0; r<count; r++)
+    {
+        uint32_t color = colors[runs[r].color];
+        __m256i v = _mm256_set1_epi32(color);
+        uint32_t *p = row + runs[r].start;
+        int n = runs[r].length;
+
+        for(; n >= 8; n -= 8, p += 8) _mm256_storeu_si256((__m256i*)p, v);
+        if(n >= 4) {
+            _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(v));
+            n -= 4; p += 4;
+        }
+        for(; n > 0; n--) *p++ = color;
+    }
+}
+#endif
+
+/* Constructor */
+Scaler::Scaler(void)
+{
+    m_Width = 64;
+    m_Height = 32;
+    m_Stretch = false;
+    m_Effect = SCALER_NONE;
+    m_Valid = false;
+
+    SetPalette(PALETTES[0].colors);
+
+#ifdef SCALER_X86
+    m_Fill = __builtin_cpu_supports("avx2") ? fillAVX2 : fillSSE2;
+#else
+    m_Fill = fillPlain;
+#endif
+
+    Layout();
+}
+
+/* Change the output size */
+void Scaler::SetOutput(int width, int height, bool stretch)
+{
+    m_Width = width < 1 ? 1 : width;
+    m_Height = height < 1 ? 1 : height;
+    m_Stretch = stretch;
+    Layout();
+}
+
+/* Set the colors */
+void Scaler::SetPalette(const uint32_t colors[4])
+{
+    for(int i=0; i<4; i++)
+    {
+        m_Colors[i] = toRGBA(colors[i]);
+
+        // half as bright
+        m_Dark[i] = toRGBA((colors[i] >> 1) & 0x7F7F7F);
+    }
+    m_Valid = false;
+}
+
+/* Set the colors by name or value */
+bool Scaler::SetPalette(const char *spec)
+{
+    for(size_t i=0; i<sizeof(PALETTES)/sizeof(PALETTES[0]); i++)
+    {
+        if(strcmp(spec, PALETTES[i].name) == 0)
+        {
+            SetPalette(PALETTES[i].colors);
+            return true;
+        }
+    }
+
+    uint32_t colors[4];
+    int count = 0;
+    const char *p = spec;
+    while(count < 4)
+    {
+        char *end;
+        colors[count++] = strtoul(p, &end, 16) & 0xFFFFFF;
+        if(end - p != 6) return false;
+        p = end;
+        if(*p == '\0') break;
+        if(*p++ != ',') return false;
+    }
+    if(*p != '\0') return false;
+
+    if(count == 2) {
+        colors[2] = colors[1];
+        colors[3] = colors[1];
+    }
+    else if(count != 4) return false;
+
+    SetPalette(colors);
+    return true;
+}
+
+/* Set the effect */
+void Scaler::SetEffect(ScalerEffect effect)
+{
+    m_Effect = effect;
+    Layout();
+}
+
+/* Work out where every screen pixel goes */
+void Scaler::Layout(void)
+{
+    // biggest size with the screen's 2:1 shape
+    m_DrawWidth = std::min(m_Width, m_Height * 2) & ~1;
+    if(!m_Stretch && m_DrawWidth >= 64) m_DrawWidth -= m_DrawWidth % 64;
+    // under 2 wide there's no room for a row: nothing is drawn
+    if(m_DrawWidth < 2) m_DrawWidth = std::min(m_Width, 2);
+    m_DrawHeight = m_DrawWidth / 2;
+
+    m_X0 = (m_Width - m_DrawWidth) / 2;
+    m_Y0 = (m_Height - m_DrawHeight) / 2;
+
+    // one run per screen column, the grid takes its last output column.
+    // colors 0-63 are the pixels of the row, 64-127 the same darkened
+    m_Runs.clear();
+    for(int x=0; x<64; x++)
+    {
+        int start = m_X0 + x * m_DrawWidth / 64;
+        int end   = m_X0 + (x+1) * m_DrawWidth / 64;
+        if(end == start) continue;
+
+        Run run = { start, end - start, x };
+        if(m_Effect == SCALER_GRID && run.length >= 3)
+        {
+            run.length--;
+            m_Runs.push_back(run);
+            Run edge = { end - 1, 1, 64 + x };
+            m_Runs.push_back(edge);
+        }
+        else m_Runs.push_back(run);
+    }
+
+    for(int y=0; y<=32; y++)
+        m_RowStart[y] = m_Y0 + y * m_DrawHeight / 32;
+
+    for(int y=0; y<32; y++)
+    {
+        int end = m_RowStart[y+1];
+        int height = end - m_RowStart[y];
+
+        m_DarkStart[y] = end;
+        if(m_Effect == SCALER_SCANLINES && height >= 2)
+            m_DarkStart[y] = end - std::max(1, height / 3);
+        else if(m_Effect == SCALER_GRID && height >= 3)
+            m_DarkStart[y] = end - 1;
+    }
+
+    m_Valid = false;
+}
+
+/* Draw the screen */
+void Scaler::Scale(const uint64_t plane0[32], const uint64_t *plane1,
+    uint8_t *out, int pitch)
+{
+    // a changed layout or palette starts from the border
+    if(!m_Valid)
+    {
+        uint32_t border = toRGBA(0);
+        for(int y=0; y<m_Height; y++)
+        {
+            uint32_t *row = (uint32_t*)(out + y * pitch);
+            std::fill(row, row + m_Width, border);
+        }
+    }
+
+    uint32_t colors[128], dark[128];
+    for(int y=0; y<32; y++)
+    {
+        uint64_t row0 = plane0[y];
+        uint64_t row1 = plane1 ? plane1[y] : 0;
+        if(m_Valid && row0 == m_Last[0][y] && row1 == m_Last[1][y])
+            continue;
+        m_Last[0][y] = row0;
+        m_Last[1][y] = row1;
+
+        // the colors of this row's pixels
+        for(int x=0; x<64; x++)
+        {
+            int index = ((row0 >> (63-x)) & 1) | (((row1 >> (63-x)) & 1) << 1);
+            colors[x] = m_Colors[index];
+            colors[64 + x] = m_Dark[index];
+            dark[x] = dark[64 + x] = m_Dark[index];
+        }
+
+        // fill the first output row (and the first darkened one), the
+        // others are copies
+        int bytes = m_DrawWidth * 4;
+        const uint8_t *first = NULL;
+        for(int oy = m_RowStart[y]; oy < m_RowStart[y+1]; oy++)
+        {
+            uint8_t *row = out + oy * pitch;
+            if(oy == m_RowStart[y] || oy == m_DarkStart[y])
+            {
+                m_Fill((uint32_t*)row, &m_Runs[0], m_Runs.size(),
+                    oy < m_DarkStart[y] ? colors : dark);
+                first = row;
+            }
+            else memcpy(row + m_X0 * 4, first + m_X0 * 4, bytes);
+        }
+    }
+
+    m_Valid = true;
+}
@@ -0,0 +1,89 @@
+/* Turns the 1 bit screen into RGBA pixels for a window of any size */
+
+#include <stdint.h>
+
+#include <vector>
+
+#ifndef SCALER_H_INCLUDED
+#define SCALER_H_INCLUDED
+
+// drawn over the scaled pixels (only where pixels are big enough)
+enum ScalerEffect
+{
+    SCALER_NONE,
+    SCALER_SCANLINES,   // darken the bottom third of every pixel row
+    SCALER_GRID         // darken the right and bottom edge of every pixel
+};
+
+// The screen is scaled by the largest factor that fits the output
+// while keeping its shape, centered with a black border. Every output
+// row is filled from a list of runs (one per pixel column, worked out
+// when the size changes) with SSE2 or, where the cpu has it, AVX2
+// stores; output rows that come from the same screen row are copied.
+// Only screen rows that changed since the last call are redrawn.
+class Scaler
+{
+public:
+    // constructor
+    Scaler(void);
+
+    // output size in pixels. 'stretch' allows scale factors that
+    // aren't whole numbers (pixels then differ in size by one)
+    void SetOutput(int width, int height, bool stretch);
+
+    // RGB (0xRRGGBB) for screen pixels that are: 0 unlit, 1 lit in
+    // plane 0, 2 lit in plane 1, 3 lit in both
+    void SetPalette(const uint32_t colors[4]);
+
+    // a named palette (classic, green, amber, lcd) or 2 or 4 colors
+    // as "RRGGBB,RRGGBB[,RRGGBB,RRGGBB]". false if it can't be read
+    bool SetPalette(const char *spec);
+
+    void SetEffect(ScalerEffect effect);
+
+    // draw the screen (rows of 64 pixels, bit 63 is x = 0) into 'out',
+    // the output size in RGBA bytes with 'pitch' bytes per row. 'plane1'
+    // is the second bitplane, or NULL. 'out' must still hold the last
+    // picture unless something was changed since
+    void Scale(const uint64_t plane0[32], const uint64_t *plane1,
+        uint8_t *out, int pitch);
+
+    // one run of output pixels of the same color
+    struct Run
+    {
+        int start;
+        int length;
+        int color;  // index into the row's color table
+    };
+
+private:
+    // work out the runs and rows for the current size and effect
+    void Layout(void);
+
+    int  m_Width, m_Height;
+    bool m_Stretch;
+    ScalerEffect m_Effect;
+
+    // where the screen goes in the output
+    int m_X0, m_Y0, m_DrawWidth, m_DrawHeight;
+
+    std::vector<Run> m_Runs;
+
+    // output rows [m_RowStart[y], m_RowStart[y+1]) show screen row y,
+    // the ones from m_DarkStart[y] on are darkened
+    int m_RowStart[33];
+    int m_DarkStart[32];
+
+    uint32_t m_Colors[4];  // RGBA in memory order
+    uint32_t m_Dark[4];
+
+    // what was drawn last time
+    uint64_t m_Last[2][32];
+    bool m_Valid;
+
+    // SSE2 or AVX2 version
+    void (*m_Fill)(uint32_t *row, const Run *runs, int count,
+        const uint32_t *colors);
+};
+
+#endif // SCALER_H_INCLUDED
@@ -0,0 +1,174 @@
+/* Live statistics in shared memory, read by chip8top */
+
+#include "Stats.hpp"
+#include "Timing.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// no POSIX shared memory in the Windows build: nothing is published
+// and chip8top isn't built
+#ifndef __WIN32
+#include <sys/mman.h>
+#endif
+
+/* Constructor */
+StatsPublisher::StatsPublisher(void)
+{
+    m_Seg = NULL;
+    m_Name[0] = '\0';
+
+    m_WindowStart = 0;
+    m_WindowWork = 0;
+    m_WindowInstructions = 0;
+}
+
+/* Deconstructor */
+StatsPublisher::~StatsPublisher(void)
+{
+    Close();
+}
+
+/* Create this process's segment */
+bool StatsPublisher::Open(const char *romName)
+{
+#ifdef __WIN32
+    (void)romName;
+    return false;
+#else
+    snprintf(m_Name, sizeof(m_Name), "/" STATS_PREFIX "%d", (int)getpid());
+
+    int fd = shm_open(m_Name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        perror("StatsPublisher::Open: shm_open");
+        return false;
+    }
+    if(ftruncate(fd, sizeof(StatsSegment)) != 0)
+    {
+        perror("StatsPublisher::Open: ftruncate");
+        close(fd);
+        shm_unlink(m_Name);
+        return false;
+    }
+
+    void *mem = mmap(NULL, sizeof(StatsSegment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+    {
+        perror("StatsPublisher::Open: mmap");
+        shm_unlink(m_Name);
+        return false;
+    }
+
+    // the new file is zeroed, so seq starts at 0 (consistent)
+    m_Seg = (StatsSegment*)mem;
+    m_Seg->pid = getpid();
+    strncpy(m_Seg->data.rom, romName, sizeof(m_Seg->data.rom) - 1);
+    memcpy(m_Seg->magic, STATS_MAGIC, 8);
+
+    m_WindowStart = NowNanos();
+
+    return true;
+#endif
+}
+
+/* Remove the segment */
+void StatsPublisher::Close(void)
+{
+    if(!m_Seg) return;
+
+#ifndef __WIN32
+    munmap(m_Seg, sizeof(StatsSegment));
+    shm_unlink(m_Name);
+#endif
+    m_Seg = NULL;
+}
+
+/* Publish the numbers for a frame */
+void StatsPublisher::FrameDone(uint64_t start, uint64_t workNs,
+    int instructions, uint16_t pc, bool dropped)
+{
+    if(!m_Seg) return;
+
+    m_WindowWork += workNs;
+    m_WindowInstructions += instructions;
+
+    // seqlock write: readers retry if they see an odd or changed seq
+    uint32_t seq = m_Seg->seq.load(std::memory_order_relaxed);
+    m_Seg->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    StatsData &d = m_Seg->data;
+    d.frames++;
+    if(dropped) d.dropped++;
+    d.frameMs = workNs / 1e6;
+    d.pc = pc;
+
+    // rates are over one second windows
+    uint64_t window = start - m_WindowStart;
+    if(window >= 1000000000ULL)
+    {
+        d.ips = m_WindowInstructions * 1e9 / window;
+        d.idlePercent = 100.0 - m_WindowWork * 100.0 / window;
+        if(d.idlePercent < 0) d.idlePercent = 0;
+
+        m_WindowStart = start;
+        m_WindowWork = 0;
+        m_WindowInstructions = 0;
+    }
+
+    m_Seg->seq.store(seq + 2, std::memory_order_release);
+}
+
+/* Read a consistent snapshot */
+bool StatsReader::Read(const char *name, int &pid, StatsData &data)
+{
+#ifdef __WIN32
+    (void)name; (void)pid; (void)data;
+    return false;
+#else
+    char path[128];
+    snprintf(path, sizeof(path), "/%s", name);
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if(fd < 0) return false;
+
+    // the publisher sizes it just after creating it, reading one that
+    // isn't there yet would fault
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(StatsSegment))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mem = mmap(NULL, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) return false;
+
+    StatsSegment *seg = (StatsSegment*)mem;
+    bool ok = memcmp(seg->magic, STATS_MAGIC, 8) == 0;
+
+    // retry until the writer wasn't in the middle of an update
+    for(int tries=0; ok; tries++)
+    {
+        uint32_t before = seg->seq.load(std::memory_order_acquire);
+        memcpy(&data, (const void*)&seg->data, sizeof(data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t after = seg->seq.load(std::memory_order_relaxed);
+
+        if(before == after && !(before & 1)) break;
+        if(tries == 1000) ok = false;
+    }
+    pid = seg->pid;
+    data.rom[sizeof(data.rom)-1] = '\0';
+
+    munmap(mem, sizeof(StatsSegment));
+    return ok;
+#endif
+}
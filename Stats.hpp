@@ -0,0 +1,74 @@
+/* Live statistics in shared memory, read by chip8top */
+
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+// segments are /dev/shm/chip8-stats-<pid>
+#define STATS_PREFIX  "chip8-stats-"
+#define STATS_MAGIC   "C8STATS1"
+
+/* the numbers that get published */
+struct StatsData
+{
+    uint64_t frames;        // frames run so far
+    uint64_t dropped;       // frames that came more than a frame late
+    double   ips;           // instructions per second (last second)
+    double   frameMs;       // time spent working on the last frame
+    double   idlePercent;   // time not spent working (last second)
+    uint16_t pc;
+    char     rom[64];
+};
+
+/* the shared memory layout */
+struct StatsSegment
+{
+    char     magic[8];
+    int32_t  pid;
+    // seqlock: odd while the writer is in the middle of an update
+    std::atomic<uint32_t> seq;
+    StatsData data;
+};
+
+// one process writes its segment...
+class StatsPublisher
+{
+public:
+    // constructor/deconstructor
+    StatsPublisher(void);
+    ~StatsPublisher(void);
+
+    // create the segment for this process
+    bool Open(const char *romName);
+
+    // remove the segment
+    void Close(void);
+
+    // a frame is done: it started at 'start', took 'workNs' of real
+    // work and ran 'instructions'. never waits
+    void FrameDone(uint64_t start, uint64_t workNs, int instructions,
+        uint16_t pc, bool dropped);
+
+private:
+    StatsSegment *m_Seg;
+    char m_Name[64];
+
+    // counters for the current one second window
+    uint64_t m_WindowStart;
+    uint64_t m_WindowWork;
+    uint64_t m_WindowInstructions;
+};
+
+// ...and anyone may read it
+class StatsReader
+{
+public:
+    // copy out a consistent snapshot of the segment 'name'
+    // (without the leading '/'). false if it's not a stats segment
+    static bool Read(const char *name, int &pid, StatsData &data);
+};
+
+#endif // STATS_H_INCLUDED
@@ -0,0 +1,210 @@
+/* Shows the screen in a terminal, no SDL needed */
+
+#include "TermDisplay.hpp"
+#include "Keypad.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __WIN32
+#include <conio.h>
+#else
+#include <poll.h>
+#endif
+
+// indexed by cell: nothing, top pixel, bottom pixel, both (utf-8)
+static const char *GLYPHS[4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" };
+
+/* write all of 'len' bytes */
+static void writeAll(const char *data, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if(n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+/* whatever was typed since last time, without waiting */
+static int readKeys(char *buf, int size)
+{
+#ifdef __WIN32
+    // the console has no raw mode: keys come from conio, and F5 (0 or
+    // 0xE0, then 0x3F) is turned into the sequence a terminal sends
+    int n = 0;
+    while(n + 5 <= size && _kbhit())
+    {
+        int c = _getch();
+        if(c == 0 || c == 0xE0)
+        {
+            if(_getch() == 0x3F) {
+                memcpy(buf + n, "\x1b[15~", 5);
+                n += 5;
+            }
+            continue;
+        }
+        buf[n++] = c;
+    }
+    return n;
+#else
+    struct pollfd pfd;
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, 0) <= 0) return 0;
+
+    ssize_t n = read(STDIN_FILENO, buf, size);
+    return n < 0 ? 0 : n;
+#endif
+}
+
+/* Constructor */
+TermDisplay::TermDisplay(void)
+{
+    m_Open = false;
+    m_Raw = false;
+    m_Reset = false;
+    memset(m_Cells, 0xFF, sizeof(m_Cells));
+    memset(m_KeyFrames, 0, sizeof(m_KeyFrames));
+    m_KeyHold = TERM_KEY_FRAMES;
+}
+
+/* Deconstructor */
+TermDisplay::~TermDisplay(void)
+{
+    close();
+}
+
+/* Set up the terminal */
+void TermDisplay::open(void)
+{
+#ifndef __WIN32
+    if(isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &m_SavedTermios) == 0)
+    {
+        // no echo, no line buffering, reads never wait
+        struct termios raw = m_SavedTermios;
+        cfmakeraw(&raw);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        m_Raw = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+#endif
+
+    // alternate screen, hide the cursor, clear
+    const char *start = "\x1b[?1049h\x1b[?25l\x1b[2J";
+    writeAll(start, strlen(start));
+
+    memset(m_Cells, 0xFF, sizeof(m_Cells));
+    m_Open = true;
+}
+
+/* Restore the terminal */
+void TermDisplay::close(void)
+{
+    if(!m_Open) return;
+
+    const char *end = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    writeAll(end, strlen(end));
+
+#ifndef __WIN32
+    if(m_Raw) tcsetattr(STDIN_FILENO, TCSANOW, &m_SavedTermios);
+#endif
+    m_Raw = false;
+    m_Open = false;
+}
+
+/* Draw what changed */
+void TermDisplay::update(const uint64_t rows[32])
+{
+    m_Out.clear();
+
+    // where the terminal's cursor is, -1 if unknown
+    int curRow = -1, curCol = -1;
+
+    for(int r=0; r<TERM_ROWS; r++)
+    {
+        uint64_t top = rows[r*2], bottom = rows[r*2 + 1];
+
+        for(int c=0; c<TERM_COLS; c++)
+        {
+            unsigned char cell = ((top >> (63-c)) & 1) |
+                (((bottom >> (63-c)) & 1) << 1);
+            if(cell == m_Cells[r][c]) continue;
+
+            if(curRow == r && c > curCol && c - curCol <= 2)
+            {
+                // a short gap is cheaper to draw again than to jump over
+                for(int g=curCol; g<c; g++) m_Out += GLYPHS[m_Cells[r][g]];
+            }
+            else if(curRow != r || curCol != c)
+            {
+                char move[16];
+                snprintf(move, sizeof(move), "\x1b[%d;%dH", r+1, c+1);
+                m_Out += move;
+            }
+
+            m_Out += GLYPHS[cell];
+            m_Cells[r][c] = cell;
+            curRow = r;
+            curCol = c+1;
+        }
+    }
+
+    if(!m_Out.empty()) writeAll(m_Out.data(), m_Out.size());
+}
+
+/* Read whatever keys were typed */
+bool TermDisplay::pollEvents(WORD &keys)
+{
+    // keys that weren't repeated are let go
+    for(int k=0; k<16; k++)
+    {
+        if(m_KeyFrames[k] > 0 && --m_KeyFrames[k] == 0)
+            keys &= ~(1 << k);
+    }
+
+    char buf[64];
+    int n;
+    while((n = readKeys(buf, sizeof(buf))) > 0)
+    {
+        for(int i=0; i<n; i++)
+        {
+            // ctrl-c (raw mode doesn't send a signal)
+            if(buf[i] == 3) return false;
+
+            if(buf[i] == 0x1B)
+            {
+                // Esc on its own exits, arrow keys and such are skipped
+                // up to their final byte
+                if(i+1 < n && (buf[i+1] == '[' || buf[i+1] == 'O'))
+                {
+                    // F5 is "Esc [ 1 5 ~"
+                    if(n - i >= 5 && memcmp(&buf[i+1], "[15~", 4) == 0)
+                        m_Reset = true;
+
+                    for(i += 2; i < n && (buf[i] < 0x40 || buf[i] > 0x7E); i++);
+                    continue;
+                }
+                return false;
+            }
+
+            int key = KeypadKey(buf[i]);
+            if(key < 0) continue;
+
+            keys |= 1 << key;
+            m_KeyFrames[key] = m_KeyHold;
+        }
+    }
+    return true;
+}
+
+/* Check for F5 */
+bool TermDisplay::takeReset(void)
+{
+    bool reset = m_Reset;
+    m_Reset = false;
+    return reset;
+}
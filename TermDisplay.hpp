@@ -0,0 +1,73 @@
+/* Shows the screen in a terminal, no SDL needed */
+
+#include <string>
+
+#ifndef __WIN32
+#include <termios.h>
+#endif
+
+#include "Chip8.hpp"
+
+#ifndef TERMDISPLAY_H_INCLUDED
+#define TERMDISPLAY_H_INCLUDED
+
+// each character cell shows two pixels stacked with the unicode half
+// blocks, so the screen takes 64x16 cells
+#define TERM_COLS 64
+#define TERM_ROWS 16
+
+// terminals only send key presses (and repeats), so a key counts as
+// held until this many frames pass without it. autorepeat starts after
+// 250-500 ms, so anything shorter drops a held key before the repeats
+// come
+#define TERM_KEY_FRAMES 30
+
+class TermDisplay
+{
+public:
+    // constructor/deconstructor
+    TermDisplay(void);
+    ~TermDisplay(void);
+
+    // take over the terminal: alternate screen, no cursor, and stdin
+    // in raw mode if it's a tty
+    void open(void);
+
+    // give the terminal back as it was
+    void close(void);
+
+    // draw the cells that changed since the last update (the screen as
+    // in Chip8::m_Screen)
+    void update(const uint64_t screen[32]);
+
+    // check keys (the same layout as Display). false once Esc or
+    // ctrl-c was pressed
+    bool pollEvents(WORD &keys);
+
+    // true once after F5 was pressed (reset and load the ROM again)
+    bool takeReset(void);
+
+    // frames a key stays held after the terminal last sent it
+    void setKeyHold(int frames){m_KeyHold = frames < 1 ? 1 : frames;}
+
+private:
+    bool m_Open;
+    bool m_Raw;
+    bool m_Reset;
+#ifndef __WIN32
+    struct termios m_SavedTermios;
+#endif
+
+    // what each cell shows now (0-3: bit 0 top pixel, bit 1 bottom),
+    // 0xFF before the first update
+    unsigned char m_Cells[TERM_ROWS][TERM_COLS];
+
+    // frames left until each key counts as released
+    int m_KeyFrames[16];
+    int m_KeyHold;
+
+    // one frame's output, written all at once
+    std::string m_Out;
+};
+
+#endif // TERMDISPLAY_H_INCLUDED
@@ -0,0 +1,17 @@
+/* Reading the clock */
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef TIMING_H_INCLUDED
+#define TIMING_H_INCLUDED
+
+/* monotonic time in nanoseconds */
+inline uint64_t NowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif // TIMING_H_INCLUDED
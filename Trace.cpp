@@ -0,0 +1,159 @@
+/* Binary execution trace */
+
+#include "Trace.hpp"
+
+#include <string.h>
+
+#include <chrono>
+
+/* Constructor */
+Tracer::Tracer(void)
+{
+    m_Blocks = new Block[TRACE_BLOCKS];
+    m_Cur = 0;
+    m_Used = 0;
+    m_Wrapped = false;
+    m_Count = 0;
+
+    m_DumpFile = NULL;
+    m_File = NULL;
+    m_Running = false;
+}
+
+/* Deconstructor */
+Tracer::~Tracer(void)
+{
+    Close();
+    delete [] m_Blocks;
+}
+
+/* Write the file header */
+bool Tracer::WriteHeader(FILE *fp)
+{
+    uint32_t header[2] = { sizeof(TraceRecord), 0 };
+
+    return fwrite(TRACE_MAGIC, 8, 1, fp) == 1 &&
+           fwrite(header, sizeof(header), 1, fp) == 1;
+}
+
+/* Read and check the file header */
+bool Tracer::ReadHeader(FILE *fp)
+{
+    char magic[8];
+    uint32_t header[2];
+
+    if(fread(magic, 8, 1, fp) != 1 || memcmp(magic, TRACE_MAGIC, 8) != 0)
+        return false;
+    if(fread(header, sizeof(header), 1, fp) != 1)
+        return false;
+
+    return header[0] == sizeof(TraceRecord);
+}
+
+/* Stream records to a file */
+bool Tracer::OpenFile(const char *fname)
+{
+    m_File = fopen(fname, "wb");
+    if(!m_File)
+    {
+        fprintf(stderr, "Tracer::OpenFile: Failed to open '%s'\n", fname);
+        return false;
+    }
+    WriteHeader(m_File);
+
+    // every block except the current one starts out free
+    for(int b=0; b<TRACE_BLOCKS; b++)
+        if(b != m_Cur) m_Free.push(b);
+
+    m_Running = true;
+    m_Writer = std::thread(&Tracer::WriterThread, this);
+
+    return true;
+}
+
+/* The current block is full */
+void Tracer::NextBlock(void)
+{
+    m_Blocks[m_Cur].used = m_Used;
+    m_Used = 0;
+
+    if(!m_File)
+    {
+        // memory only - reuse the oldest block
+        m_Cur = (m_Cur + 1) % TRACE_BLOCKS;
+        if(m_Cur == 0) m_Wrapped = true;
+        return;
+    }
+
+    m_Full.push(m_Cur);
+
+    // only waits if the disk can't keep up
+    while(!m_Free.pop(m_Cur))
+        std::this_thread::yield();
+}
+
+/* Write full blocks to the file */
+void Tracer::WriterThread(void)
+{
+    for(;;)
+    {
+        bool running = m_Running;
+
+        int b;
+        while(m_Full.pop(b))
+        {
+            fwrite(m_Blocks[b].records, sizeof(TraceRecord),
+                m_Blocks[b].used, m_File);
+            m_Free.push(b);
+        }
+
+        if(!running) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/* Flush and stop */
+void Tracer::Close(void)
+{
+    if(!m_File)
+    {
+        if(m_DumpFile) Dump(m_DumpFile);
+        m_DumpFile = NULL;
+        return;
+    }
+
+    // hand over the partly filled block and wait for the writer
+    m_Blocks[m_Cur].used = m_Used;
+    m_Full.push(m_Cur);
+    m_Running = false;
+    m_Writer.join();
+
+    fclose(m_File);
+    m_File = NULL;
+}
+
+/* Write the records still in memory */
+bool Tracer::Dump(const char *fname)
+{
+    FILE *fp = fopen(fname, "wb");
+    if(!fp)
+    {
+        fprintf(stderr, "Tracer::Dump: Failed to open '%s'\n", fname);
+        return false;
+    }
+    WriteHeader(fp);
+
+    // oldest block first, the current one last
+    m_Blocks[m_Cur].used = m_Used;
+    int first = m_Wrapped ? (m_Cur + 1) % TRACE_BLOCKS : 0;
+    for(int b = first; ; b = (b + 1) % TRACE_BLOCKS)
+    {
+        fwrite(m_Blocks[b].records, sizeof(TraceRecord),
+            m_Blocks[b].used, fp);
+        if(b == m_Cur) break;
+    }
+
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,106 @@
+/* Binary execution trace */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "RingBuffer.hpp"
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+// file header: TRACE_MAGIC, then the record size as a 32 bit value,
+// then 4 reserved bytes, then the records
+#define TRACE_MAGIC "C8TRACE1"
+
+// no register changed
+#define TRACE_NO_REG 0xFF
+
+/* one executed instruction (16 bytes, written to disk as is) */
+struct TraceRecord
+{
+    uint64_t count;   // instruction number
+    uint16_t pc;      // address of the instruction
+    uint16_t opcode;
+    uint16_t i;       // I after the instruction
+    uint8_t  reg;     // lowest register it changed, or TRACE_NO_REG
+    uint8_t  value;   // new value of that register
+};
+
+class Tracer
+{
+public:
+    // constructor/deconstructor
+    Tracer(void);
+    ~Tracer(void);
+
+    // stream every record to a file from a background thread.
+    // without this only the last TRACE_BLOCKS*TRACE_BLOCK_RECORDS
+    // records are kept in memory (see Dump)
+    bool OpenFile(const char *fname);
+
+    // (when not streaming) write the records still in memory, oldest
+    // first
+    bool Dump(const char *fname);
+
+    // (when not streaming) Dump() to 'fname' in Close()
+    void DumpOnClose(const char *fname){m_DumpFile = fname;}
+
+    // flush and stop the writer thread
+    void Close(void);
+
+    // add a record (called for every instruction)
+    void Record(uint16_t pc, uint16_t opcode, uint16_t i,
+        uint8_t reg, uint8_t value)
+    {
+        TraceRecord &r = m_Blocks[m_Cur].records[m_Used++];
+        r.count  = m_Count++;
+        r.pc     = pc;
+        r.opcode = opcode;
+        r.i      = i;
+        r.reg    = reg;
+        r.value  = value;
+
+        if(m_Used == TRACE_BLOCK_RECORDS) NextBlock();
+    }
+
+    // write the file header
+    static bool WriteHeader(FILE *fp);
+
+    // read and check the file header
+    static bool ReadHeader(FILE *fp);
+
+private:
+    static const int TRACE_BLOCK_RECORDS = 8192;
+    static const int TRACE_BLOCKS        = 16;
+
+    struct Block
+    {
+        TraceRecord records[TRACE_BLOCK_RECORDS];
+        int used;
+    };
+
+    // the current block is full, get another one
+    void NextBlock(void);
+
+    void WriterThread(void);
+
+    Block *m_Blocks;
+    int    m_Cur;      // block being filled
+    int    m_Used;     // records used in it
+    bool   m_Wrapped;  // (memory only) older blocks have been reused
+    uint64_t m_Count;
+
+    const char *m_DumpFile;
+
+    // streaming: full blocks go to the writer, which hands them back
+    FILE *m_File;
+    RingBuffer<int, TRACE_BLOCKS> m_Full;
+    RingBuffer<int, TRACE_BLOCKS> m_Free;
+    std::atomic<bool> m_Running;
+    std::thread m_Writer;
+};
+
+#endif // TRACE_H_INCLUDED
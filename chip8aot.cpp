@@ -0,0 +1,526 @@
+/* Compiles a ROM ahead of time into a module for --aot */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+#include "Aot.hpp"
+#include "Timing.hpp"
+
+// blocks are cut after this many instructions
+#define AOT_MAX_BLOCK 64
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] ROM OUT\n", prog);
+    printf("  OUT ending in .cpp only writes the C++, anything else (e.g.\n");
+    printf("  game.so) also compiles it next to it with the host compiler\n");
+    printf("  --quirks NAME  profile to compile for (default: what the\n");
+    printf("                 emulator picks for ROM)\n");
+    printf("  --cxx CMD      compiler (default $CXX or g++)\n");
+    printf("  -I DIR         where Chip8.hpp is (default: next to %s)\n", prog);
+    printf("  --verify N     run N frames with and without the module\n");
+    printf("                 and check every frame ends the same\n");
+    printf("  --ops N        instructions per frame for --verify (default 1000)\n");
+}
+
+/* what an instruction does to the flow of a block */
+enum OpFlow
+{
+    FLOW_NEXT,          // carries on with the next instruction
+    FLOW_END,           // sets m_PC itself (jumps, calls, returns, skips)
+    FLOW_INTERPRET,     // left to the interpreter: CXNN, FX0A, and the
+                        // memory writes FX33/FX55 (they may change code)
+    FLOW_INVALID        // the interpreter stops on it
+};
+
+/* decoded the same way as Chip8::ExecuteNextInstruction */
+static OpFlow flowOf(WORD op)
+{
+    int n = op & 0xF, nn = op & 0xFF;
+
+    switch(op >> 12)
+    {
+        case 0x0:
+            if(op == 0x00E0) return FLOW_NEXT;
+            if(op == 0x00EE) return FLOW_END;
+            return FLOW_INVALID;
+        case 0x1: case 0x2: case 0x3: case 0x4:
+        case 0x5: case 0x9: case 0xB:
+            return FLOW_END;
+        case 0x6: case 0x7: case 0xA: case 0xD:
+            return FLOW_NEXT;
+        case 0x8:
+            return (n <= 0x7 || n == 0xE) ? FLOW_NEXT : FLOW_INVALID;
+        case 0xC:
+            return FLOW_INTERPRET;
+        case 0xE:
+            return (nn == 0x9E || nn == 0xA1) ? FLOW_END : FLOW_INVALID;
+        case 0xF:
+            switch(nn)
+            {
+                case 0x07: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x65:
+                    return FLOW_NEXT;
+                case 0x0A: case 0x33: case 0x55:
+                    return FLOW_INTERPRET;
+            }
+            return FLOW_INVALID;
+    }
+    return FLOW_INVALID;
+}
+
+/* where control can go after a FLOW_END instruction at 'pc' */
+static void successors(WORD pc, WORD op, std::vector<int> &out)
+{
+    switch(op >> 12)
+    {
+        case 0x1: out.push_back(op & 0xFFF); break;
+        case 0x2: out.push_back(op & 0xFFF); out.push_back(pc + 2); break;
+        case 0x3: case 0x4: case 0x5: case 0x9: case 0xE:
+            out.push_back(pc + 2);
+            out.push_back(pc + 4);
+            break;
+        // 00EE and BNNN go somewhere only known at runtime; returns
+        // land after a 2NNN, which is already a leader
+    }
+}
+
+/* the C++ for one instruction, with the same effect as its handler
+ * in OpFuncs.cpp (V is c.m_Registers, Q the quirk profile) */
+static void emitOp(FILE *fp, WORD pc, WORD op)
+{
+    int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF, n = op & 0xF;
+    int nn = op & 0xFF, nnn = op & 0xFFF;
+    int skip = pc + 4, next = pc + 2;
+
+    fprintf(fp, "    // %03X: %04X\n", pc, op);
+    switch(op >> 12)
+    {
+        case 0x0:
+            if(op == 0x00E0) fprintf(fp, "    memset(c.m_Screen, 0, sizeof(c.m_Screen));\n");
+            else fprintf(fp, "    c.m_PC = c.m_Stack.back();\n    c.m_Stack.pop_back();\n");
+            break;
+        case 0x1: fprintf(fp, "    c.m_PC = 0x%03X;\n", nnn); break;
+        case 0x2:
+            fprintf(fp, "    c.m_Stack.push_back(0x%03X);\n    c.m_PC = 0x%03X;\n", next, nnn);
+            break;
+        case 0x3: fprintf(fp, "    c.m_PC = V[%d] == 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next); break;
+        case 0x4: fprintf(fp, "    c.m_PC = V[%d] != 0x%02X ? 0x%03X : 0x%03X;\n", x, nn, skip, next); break;
+        case 0x5: fprintf(fp, "    c.m_PC = V[%d] == V[%d] ? 0x%03X : 0x%03X;\n", x, y, skip, next); break;
+        case 0x9: fprintf(fp, "    c.m_PC = V[%d] != V[%d] ? 0x%03X : 0x%03X;\n", x, y, skip, next); break;
+        case 0x6: fprintf(fp, "    V[%d] = 0x%02X;\n", x, nn); break;
+        case 0x7: fprintf(fp, "    V[%d] += 0x%02X;\n", x, nn); break;
+        case 0x8:
+            switch(n)
+            {
+                case 0x0: fprintf(fp, "    V[%d] = V[%d];\n", x, y); break;
+                case 0x1: fprintf(fp, "    logic(c, %d, V[%d] | V[%d]);\n", x, x, y); break;
+                case 0x2: fprintf(fp, "    logic(c, %d, V[%d] & V[%d]);\n", x, x, y); break;
+                case 0x3: fprintf(fp, "    logic(c, %d, V[%d] ^ V[%d]);\n", x, x, y); break;
+                case 0x4: fprintf(fp, "    add(c, %d, %d);\n", x, y); break;
+                case 0x5: fprintf(fp, "    sub(c, %d, %d);\n", x, y); break;
+                case 0x6: fprintf(fp, "    shr(c, %d, %d);\n", x, y); break;
+                case 0x7: fprintf(fp, "    subn(c, %d, %d);\n", x, y); break;
+                case 0xE: fprintf(fp, "    shl(c, %d, %d);\n", x, y); break;
+            }
+            break;
+        case 0xA: fprintf(fp, "    c.m_AddressI = 0x%03X;\n", nnn); break;
+        case 0xB:
+            fprintf(fp, "    c.m_PC = V[Q::JUMP_USES_VX ? %d : 0] + 0x%03X;\n", x, nnn);
+            break;
+        case 0xD: fprintf(fp, "    draw(c, %d, %d, %d);\n", x, y, n); break;
+        case 0xE:
+            fprintf(fp, "    c.m_PC = c.m_Keys[V[%d]] == %d ? 0x%03X : 0x%03X;\n",
+                x, nn == 0x9E ? 1 : 0, skip, next);
+            break;
+        case 0xF:
+            switch(nn)
+            {
+                case 0x07: fprintf(fp, "    V[%d] = c.DelayTimer();\n", x); break;
+                case 0x15:
+                    fprintf(fp, "    c.m_DelayTimer = V[%d];\n    c.m_DelaySetCycle = c.m_Cycles;\n", x);
+                    break;
+                case 0x18:
+                    fprintf(fp, "    c.m_SoundTimer = V[%d];\n    c.m_SoundSetCycle = c.m_Cycles;\n", x);
+                    break;
+                case 0x1E: fprintf(fp, "    c.m_AddressI += V[%d];\n", x); break;
+                case 0x29: fprintf(fp, "    c.m_AddressI = V[%d]*5;\n", x); break;
+                case 0x65: fprintf(fp, "    load(c, %d);\n", x); break;
+            }
+            break;
+    }
+}
+
+// helpers the blocks call, written like the handlers in OpFuncs.cpp
+static const char *PRELUDE =
+"#define V c.m_Registers\n"
+"\n"
+"/* 8XY1/8XY2/8XY3 */\n"
+"static inline void logic(Chip8 &c, int x, int value)\n"
+"{\n"
+"    V[x] = value;\n"
+"    if(Q::LOGIC_RESETS_VF) V[0xF] = 0;\n"
+"}\n"
+"\n"
+"/* 8XY4 */\n"
+"static inline void add(Chip8 &c, int x, int y)\n"
+"{\n"
+"    V[0xF] = 0;\n"
+"    int value = V[x] + V[y];\n"
+"    if(value > 255) V[0xF] = 1;\n"
+"    V[x] = V[x] + V[y];\n"
+"}\n"
+"\n"
+"/* 8XY5 */\n"
+"static inline void sub(Chip8 &c, int x, int y)\n"
+"{\n"
+"    V[0xF] = 1;\n"
+"    int xval = V[x], yval = V[y];\n"
+"    if(xval < yval) V[0xF] = 0;\n"
+"    V[x] = V[x] - V[y];\n"
+"}\n"
+"\n"
+"/* 8XY6 */\n"
+"static inline void shr(Chip8 &c, int x, int y)\n"
+"{\n"
+"    int s = Q::SHIFT_USES_VY ? y : x;\n"
+"    int lsb = V[s] & 1, value = V[s];\n"
+"    V[0xF] = lsb;\n"
+"    V[x] = value >> 1;\n"
+"}\n"
+"\n"
+"/* 8XY7 */\n"
+"static inline void subn(Chip8 &c, int x, int y)\n"
+"{\n"
+"    V[0xF] = 1;\n"
+"    if(V[x] > V[y]) V[0xF] = 0;\n"
+"    V[x] = V[y] - V[x];\n"
+"}\n"
+"\n"
+"/* 8XYE */\n"
+"static inline void shl(Chip8 &c, int x, int y)\n"
+"{\n"
+"    int s = Q::SHIFT_USES_VY ? y : x;\n"
+"    int msb = V[s] >> 7, value = V[s];\n"
+"    V[0xF] = msb;\n"
+"    V[x] = value << 1;\n"
+"}\n"
+"\n"
+"/* DXYN */\n"
+"static inline void draw(Chip8 &c, int x, int y, int height)\n"
+"{\n"
+"    int coordx = V[x] % 64;\n"
+"    int coordy = V[y] % 32;\n"
+"    V[0xF] = 0;\n"
+"    for(int yline=0; yline < height; yline++)\n"
+"    {\n"
+"        int py = coordy + yline;\n"
+"        if(py >= 32)\n"
+"        {\n"
+"            if(Q::CLIP_SPRITES) break;\n"
+"            py -= 32;\n"
+"        }\n"
+"        uint64_t data = (uint64_t)c.m_GameMemory[c.m_AddressI + yline] << 56;\n"
+"        uint64_t mask = data >> coordx;\n"
+"        if(!Q::CLIP_SPRITES && coordx > 56)\n"
+"            mask |= data << (64 - coordx);\n"
+"        if(c.m_Screen[py] & mask) V[0xF] = 1;\n"
+"        c.m_Screen[py] ^= mask;\n"
+"    }\n"
+"}\n"
+"\n"
+"/* FX65 */\n"
+"static inline void load(Chip8 &c, int x)\n"
+"{\n"
+"    for(int i=0; i<=x; i++) V[i] = c.m_GameMemory[c.m_AddressI+i];\n"
+"    if(Q::LOADSTORE_INCREMENTS) c.m_AddressI = c.m_AddressI + x + 1;\n"
+"}\n";
+
+/* the quirk profile's type name */
+static const char *profileType(const char *name)
+{
+#define PROFILE_TYPE(Q) if(strcmp(name, Q::Name()) == 0) return #Q;
+    CHIP8_QUIRK_PROFILES(PROFILE_TYPE)
+#undef PROFILE_TYPE
+    return NULL;
+}
+
+struct Block
+{
+    int start;
+    std::vector<WORD> ops;
+};
+
+/* find the blocks reachable from 0x200 */
+static void discover(const BYTE *mem, int romEnd, std::vector<Block> &blocks)
+{
+    std::set<int> seen;
+    std::vector<int> work(1, 0x200);
+
+    while(!work.empty())
+    {
+        int start = work.back();
+        work.pop_back();
+        if(start < 0x200 || start + 2 > romEnd || !seen.insert(start).second)
+            continue;
+
+        Block b;
+        b.start = start;
+        int pc = start;
+        for(;;)
+        {
+            if(pc + 2 > romEnd) break;
+
+            WORD op = (mem[pc] << 8) | mem[pc+1];
+            OpFlow flow = flowOf(op);
+
+            if(flow == FLOW_INVALID) break;
+            if(flow == FLOW_INTERPRET) {
+                // the interpreter runs it, then it's back to blocks
+                work.push_back(pc + 2);
+                break;
+            }
+
+            b.ops.push_back(op);
+            pc += 2;
+
+            if(flow == FLOW_END) {
+                successors(pc - 2, op, work);
+                break;
+            }
+            if(b.ops.size() == AOT_MAX_BLOCK) {
+                work.push_back(pc);
+                break;
+            }
+        }
+
+        if(!b.ops.empty()) blocks.push_back(b);
+    }
+}
+
+/* write the module's source */
+static bool writeSource(const char *fname, const char *rom, const BYTE *mem,
+    int romEnd, const char *quirks, const std::vector<Block> &blocks)
+{
+    FILE *fp = fopen(fname, "w");
+    if(!fp) {
+        fprintf(stderr, "Failed to write '%s'\n", fname);
+        return false;
+    }
+
+    fprintf(fp, "/* %s compiled by chip8aot for the %s profile, do not edit */\n\n",
+        rom, quirks);
+    fprintf(fp, "#include <cstring>\n\n#include \"Chip8.hpp\"\n#include \"Aot.hpp\"\n\n");
+    fprintf(fp, "typedef %s Q;\n\n%s\n", profileType(quirks), PRELUDE);
+
+    fprintf(fp, "static const uint8_t ROM[] = {");
+    for(int a=0x200; a<romEnd; a++)
+        fprintf(fp, "%s0x%02X,", (a - 0x200) % 16 ? " " : "\n    ", mem[a]);
+    fprintf(fp, "\n};\n");
+
+    for(size_t i=0; i<blocks.size(); i++)
+    {
+        const Block &b = blocks[i];
+        int count = b.ops.size();
+        fprintf(fp, "\nstatic void b_%03X(Chip8 &c)\n{\n", b.start);
+
+        // the timers read m_Cycles, so it's brought up to date first
+        int counted = 0;
+        for(int k=0; k<count; k++)
+        {
+            WORD op = b.ops[k];
+            int nn = op & 0xFF;
+            bool timer = (op >> 12) == 0xF && (nn == 0x07 || nn == 0x15 || nn == 0x18);
+            if(timer && k > counted) {
+                fprintf(fp, "    c.m_Cycles += %d;\n", k - counted);
+                counted = k;
+            }
+            emitOp(fp, b.start + k*2, op);
+        }
+
+        fprintf(fp, "    c.m_Cycles += %d;\n", count - counted);
+        if(flowOf(b.ops.back()) != FLOW_END)
+            fprintf(fp, "    c.m_PC = 0x%03X;\n", b.start + count*2);
+        fprintf(fp, "}\n");
+    }
+
+    fprintf(fp, "\nstatic const AotBlock BLOCKS[] = {\n");
+    for(size_t i=0; i<blocks.size(); i++)
+        fprintf(fp, "    { 0x%03X, %d, b_%03X },\n", blocks[i].start,
+            (int)blocks[i].ops.size(), blocks[i].start);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "extern \"C\" {\n");
+    fprintf(fp, "extern const AotInfo %s;\n", CHIP8_AOT_SYMBOL);
+    fprintf(fp, "const AotInfo %s = {\n", CHIP8_AOT_SYMBOL);
+    fprintf(fp, "    CHIP8_AOT_ABI, sizeof(Chip8), \"%s\", ROM, sizeof(ROM),\n", quirks);
+    fprintf(fp, "    BLOCKS, sizeof(BLOCKS) / sizeof(BLOCKS[0])\n};\n}\n");
+
+    fclose(fp);
+    return true;
+}
+
+/* run 'frames' frames interpreted and through the module, comparing the
+ * whole machine after each */
+static bool verify(const char *rom, const char *quirks, const char *module,
+    int frames, int ops)
+{
+    Chip8 *chips[2];
+    for(int i=0; i<2; i++)
+    {
+        chips[i] = new Chip8;
+        chips[i]->CPUReset();
+        chips[i]->SetSeed(1);
+        if(!chips[i]->LoadROM(rom) || !chips[i]->SetQuirks(quirks)) return false;
+        chips[i]->SetCyclesPerTick(ops);
+    }
+    if(!chips[1]->LoadAot(module)) return false;
+
+    std::vector<BYTE> states[2];
+    states[0].resize(Chip8::StateSize());
+    states[1].resize(Chip8::StateSize());
+
+    uint64_t time[2] = { 0, 0 };
+    unsigned int keySeed = 1;
+    bool ok = true;
+    int f;
+    for(f=0; f<frames && ok; f++)
+    {
+        // press or let go of a key now and then, the same for both
+        keySeed = keySeed * 1103515245 + 12345;
+        int key = -1;
+        if(((keySeed >> 16) & 7) == 0) key = (keySeed >> 20) & 0xF;
+
+        bool ran[2];
+        for(int i=0; i<2; i++)
+        {
+            if(key >= 0) chips[i]->SetKey(key, !chips[i]->m_Keys[key]);
+
+            uint64_t start = NowNanos();
+            if(i == 0) {
+                ran[i] = true;
+                for(int k=0; k<ops && ran[i]; k++) ran[i] = chips[i]->RunNextInstruction();
+            }
+            else ran[i] = chips[i]->RunCycles(ops);
+            time[i] += NowNanos() - start;
+        }
+
+        bool saved = chips[0]->SaveState(&states[0][0]) &&
+            chips[1]->SaveState(&states[1][0]);
+        if(ran[0] != ran[1] || states[0] != states[1] ||
+            chips[0]->m_Stack != chips[1]->m_Stack)
+        {
+            printf("frame %d: differs (PC %03X interpreted, %03X compiled)\n",
+                f, chips[0]->m_PC, chips[1]->m_PC);
+            ok = false;
+        }
+        if(!saved && ok) {
+            // stack too deep for a snapshot, the stacks are compared above
+            // and the rest below
+            ok = memcmp(chips[0]->m_GameMemory, chips[1]->m_GameMemory,
+                sizeof(chips[0]->m_GameMemory)) == 0;
+        }
+        if(!ran[0]) {
+            printf("frame %d: unhandled opcode, stopping\n", f++);
+            break;
+        }
+    }
+
+    if(ok)
+        printf("verified %d frames of %d instructions: interpreted %.1f ms, "
+            "compiled %.1f ms\n", f, ops, time[0] / 1e6, time[1] / 1e6);
+
+    delete chips[0];
+    delete chips[1];
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    const char *rom = NULL, *out = NULL, *quirks = NULL;
+    const char *cxx = getenv("CXX") ? getenv("CXX") : "g++";
+    std::string incDir;
+    int verifyFrames = 0;
+    int ops = 1000;
+
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "--quirks") == 0 && i+1 < argc)      quirks = argv[++i];
+        else if(strcmp(argv[i], "--cxx") == 0 && i+1 < argc)    cxx = argv[++i];
+        else if(strcmp(argv[i], "-I") == 0 && i+1 < argc)       incDir = argv[++i];
+        else if(strcmp(argv[i], "--verify") == 0 && i+1 < argc) verifyFrames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--ops") == 0 && i+1 < argc)    ops = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && !rom)  rom = argv[i];
+        else if(argv[i][0] != '-' && !out)  out = argv[i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(!rom || !out || ops < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    if(incDir.empty())
+    {
+        const char *slash = strrchr(argv[0], '/');
+        incDir = slash ? std::string(argv[0], slash - argv[0]) : ".";
+    }
+
+    // load it the way the emulator does
+    Chip8 *chip = new Chip8;
+    chip->CPUReset();
+    if(!chip->LoadROM(rom)) return 1;
+    if(quirks && !chip->SetQuirks(quirks)) {
+        fprintf(stderr, "Unknown quirk profile '%s'\n", quirks);
+        return 1;
+    }
+    quirks = chip->GetQuirks();
+
+    FILE *fp = fopen(rom, "rb");
+    fseek(fp, 0, SEEK_END);
+    int romEnd = 0x200 + std::min(ftell(fp), (long)sizeof(chip->m_GameMemory) - 0x200);
+    fclose(fp);
+
+    std::vector<Block> blocks;
+    discover(chip->m_GameMemory, romEnd, blocks);
+
+    int instructions = 0;
+    for(size_t i=0; i<blocks.size(); i++) instructions += blocks[i].ops.size();
+    printf("%s: %d blocks, %d instructions (%s profile)\n", rom,
+        (int)blocks.size(), instructions, quirks);
+
+    // OUT.cpp, or the source next to the module
+    std::string module = out, source = out;
+    size_t dot = source.rfind('.');
+    bool sourceOnly = dot != std::string::npos && source.substr(dot) == ".cpp";
+    if(!sourceOnly)
+        source = (dot == std::string::npos ? source : source.substr(0, dot)) + ".cpp";
+
+    if(!writeSource(source.c_str(), rom, chip->m_GameMemory, romEnd, quirks, blocks))
+        return 1;
+    if(sourceOnly) return 0;
+
+    std::string cmd = std::string(cxx) + " -O2 -shared -fPIC -I\"" + incDir +
+        "\" \"" + source + "\" -o \"" + module + "\"";
+    printf("%s\n", cmd.c_str());
+    if(system(cmd.c_str()) != 0) {
+        fprintf(stderr, "Compiling '%s' failed\n", source.c_str());
+        return 1;
+    }
+
+    // a relative path would be looked up in the library path
+    if(module.find('/') == std::string::npos) module = "./" + module;
+    if(verifyFrames > 0 && !verify(rom, quirks, module.c_str(), verifyFrames, ops))
+        return 1;
+
+    delete chip;
+    return 0;
+}
@@ -0,0 +1,80 @@
+/* Shows the live statistics of every running emulator, like top */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "Stats.hpp"
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -1         print the table once and exit\n");
+    printf("  -d SECS    refresh interval (default 1)\n");
+}
+
+/* print one line per running emulator */
+static void printTable(void)
+{
+    printf("%7s %-20s %9s %10s %9s %8s %6s %5s\n", "PID", "ROM", "FRAMES",
+        "IPS", "FRAME ms", "DROPPED", "IDLE%", "PC");
+
+    DIR *dir = opendir("/dev/shm");
+    if(!dir) return;
+
+    struct dirent *e;
+    while((e = readdir(dir)) != NULL)
+    {
+        if(strncmp(e->d_name, STATS_PREFIX, strlen(STATS_PREFIX)) != 0)
+            continue;
+
+        int pid;
+        StatsData d;
+        if(!StatsReader::Read(e->d_name, pid, d)) continue;
+
+        // left behind by a process that was killed
+        if(kill(pid, 0) != 0) continue;
+
+        // show the file name, not the path
+        const char *rom = strrchr(d.rom, '/');
+        rom = rom ? rom+1 : d.rom;
+
+        printf("%7d %-20.20s %9llu %10.0f %9.2f %8llu %6.1f %5X\n", pid, rom,
+            (unsigned long long)d.frames, d.ips, d.frameMs,
+            (unsigned long long)d.dropped, d.idlePercent, d.pc);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    bool once = false;
+    double delay = 1.0;
+
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-1") == 0)                  once = true;
+        else if(strcmp(argv[i], "-d") == 0 && i+1 < argc) delay = atof(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    for(;;)
+    {
+        // clear the terminal and go to the top left
+        if(!once) printf("\033[H\033[2J");
+        printTable();
+        fflush(stdout);
+
+        if(once) break;
+        usleep((useconds_t)(delay * 1e6));
+    }
+
+    return 0;
+}
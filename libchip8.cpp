@@ -0,0 +1,134 @@
+/* C interface to the emulator core (libchip8) */
+
+#include "libchip8.h"
+
+// the public event bits, kept before Chip8.hpp defines the core's own
+// (a different value there also warns that the macro was redefined)
+enum
+{
+    LIB_EVENT_SCREEN  = CHIP8_EVENT_SCREEN,
+    LIB_EVENT_KEYWAIT = CHIP8_EVENT_KEYWAIT,
+    LIB_EVENT_SOUND   = CHIP8_EVENT_SOUND,
+    LIB_EVENT_BADOP   = CHIP8_EVENT_BADOP
+};
+
+#include "Chip8.hpp"
+
+#include <new>
+
+// chip8_run_until() hands Chip8::Run()'s bits straight out
+static_assert(LIB_EVENT_SCREEN == CHIP8_EVENT_SCREEN &&
+    LIB_EVENT_KEYWAIT == CHIP8_EVENT_KEYWAIT &&
+    LIB_EVENT_SOUND == CHIP8_EVENT_SOUND &&
+    LIB_EVENT_BADOP == CHIP8_EVENT_BADOP,
+    "libchip8.h and Chip8.hpp disagree on the CHIP8_EVENT_* bits");
+
+struct chip8
+{
+    Chip8 chip;
+};
+
+chip8_t *chip8_create(void)
+{
+    chip8_t *c = new(std::nothrow) chip8_t;
+    if(!c) return NULL;
+
+    c->chip.CPUReset();
+
+    return c;
+}
+
+void chip8_destroy(chip8_t *c)
+{
+    delete c;
+}
+
+int chip8_load_rom_file(chip8_t *c, const char *path)
+{
+    return c->chip.LoadROM(path) ? 0 : -1;
+}
+
+int chip8_load_rom(chip8_t *c, const unsigned char *data, size_t size)
+{
+    return c->chip.LoadROM(data, (int)size) ? 0 : -1;
+}
+
+int chip8_set_quirks(chip8_t *c, const char *name)
+{
+    return c->chip.SetQuirks(name) ? 0 : -1;
+}
+
+void chip8_set_seed(chip8_t *c, unsigned int seed)
+{
+    c->chip.SetSeed(seed);
+}
+
+void chip8_set_clock(chip8_t *c, int ops_per_second)
+{
+    c->chip.SetCyclesPerTick(ops_per_second / 60);
+}
+
+int chip8_run(chip8_t *c, int cycles)
+{
+    // compiled blocks count their instructions in as they go
+    uint64_t start = c->chip.GetCycles();
+    c->chip.RunCycles(cycles);
+    return (int)(c->chip.GetCycles() - start);
+}
+
+int chip8_run_until(chip8_t *c, int cycles, chip8_event_t *ev)
+{
+    Chip8Event e = c->chip.Run(cycles);
+    ev->events = e.events;
+    ev->cycles = e.cycles;
+    ev->pc = e.pc;
+    return e.events;
+}
+
+int chip8_load_aot(chip8_t *c, const char *path)
+{
+    return c->chip.LoadAot(path) ? 0 : -1;
+}
+
+void chip8_skip(chip8_t *c, unsigned long cycles)
+{
+    c->chip.SkipCycles(cycles);
+}
+
+void chip8_set_key(chip8_t *c, int key, int pressed)
+{
+    if(key < 0 || key > 0xF) return;
+    c->chip.SetKey(key, pressed ? 1 : 0);
+}
+
+int chip8_sound_on(chip8_t *c)
+{
+    return c->chip.SoundOn() ? 1 : 0;
+}
+
+void chip8_framebuffer(chip8_t *c, unsigned char pixels[CHIP8_WIDTH * CHIP8_HEIGHT])
+{
+    uint64_t rows[32];
+    c->chip.GetScreenRows(rows);
+
+    for(int y=0; y<CHIP8_HEIGHT; y++)
+        for(int x=0; x<CHIP8_WIDTH; x++)
+            pixels[y*CHIP8_WIDTH + x] = (rows[y] >> (63 - x)) & 1;
+}
+
+size_t chip8_snapshot_size(void)
+{
+    return Chip8::StateSize();
+}
+
+int chip8_snapshot_save(chip8_t *c, void *buf, size_t size)
+{
+    if(size < chip8_snapshot_size()) return -1;
+    return c->chip.SaveState((BYTE*)buf) ? 0 : -1;
+}
+
+int chip8_snapshot_load(chip8_t *c, const void *buf, size_t size)
+{
+    if(size < chip8_snapshot_size()) return -1;
+    return c->chip.LoadState((const BYTE*)buf) ? 0 : -1;
+}
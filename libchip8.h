@@ -0,0 +1,98 @@
+/* C interface to the emulator core (libchip8) */
+
+#ifndef LIBCHIP8_H_INCLUDED
+#define LIBCHIP8_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* only the functions below are exported from libchip8.so */
+#if defined(__GNUC__)
+#define CHIP8_API __attribute__((visibility("default")))
+#else
+#define CHIP8_API
+#endif
+
+#define CHIP8_WIDTH  64
+#define CHIP8_HEIGHT 32
+
+/* why chip8_run_until() stopped, bits of chip8_event_t.events */
+#define CHIP8_EVENT_SCREEN  0x01 /* DXYN or 00E0 ran */
+#define CHIP8_EVENT_KEYWAIT 0x02 /* FX0A is waiting for a key */
+#define CHIP8_EVENT_SOUND   0x04 /* the sound timer started or stopped */
+#define CHIP8_EVENT_BADOP   0x08 /* unhandled opcode at pc. the PC has moved
+                                    past it, so running again carries on
+                                    from the next instruction */
+
+/* what chip8_run_until() did */
+typedef struct chip8_event
+{
+    int events;         /* CHIP8_EVENT_* bits, 0 if the budget ran out */
+    int cycles;         /* instructions run (or waited out) */
+    unsigned short pc;  /* address of the instruction that stopped it */
+} chip8_event_t;
+
+/* one emulator; the contents are private */
+typedef struct chip8 chip8_t;
+
+/* create a reset machine (NULL if out of memory) and free it */
+CHIP8_API chip8_t *chip8_create(void);
+CHIP8_API void     chip8_destroy(chip8_t *c);
+
+/* load a ROM at 0x200. the file version also picks the quirk
+ * profile from a '<ROM>.quirks' file. return 0 on success, -1 on error */
+CHIP8_API int chip8_load_rom_file(chip8_t *c, const char *path);
+CHIP8_API int chip8_load_rom(chip8_t *c, const unsigned char *data, size_t size);
+
+/* "legacy", "vip" or "schip". 0 on success, -1 for an unknown name */
+CHIP8_API int chip8_set_quirks(chip8_t *c, const char *name);
+
+/* seed the random numbers used by CXNN, for repeatable runs */
+CHIP8_API void chip8_set_seed(chip8_t *c, unsigned int seed);
+
+/* instructions per second (default 400). the timers count down once
+ * every ops_per_second/60 instructions */
+CHIP8_API void chip8_set_clock(chip8_t *c, int ops_per_second);
+
+/* run the ROM's code through a module made by chip8aot where memory
+ * still holds it (load the ROM first). 0 on success, -1 on error */
+CHIP8_API int chip8_load_aot(chip8_t *c, const char *path);
+
+/* let 'cycles' instructions' worth of time pass without running any
+ * (the timers count down as if they had run). takes constant time */
+CHIP8_API void chip8_skip(chip8_t *c, unsigned long cycles);
+
+/* run 'cycles' instructions. returns how many ran, which is fewer
+ * than 'cycles' only if an unhandled opcode (counted as run) stopped
+ * the machine */
+CHIP8_API int chip8_run(chip8_t *c, int cycles);
+
+/* run up to 'cycles' instructions, stopping after the first one that
+ * changes the screen, starts or stops the sound, or waits for a key
+ * with FX0A (the rest of 'cycles' is then waited out at once). fills
+ * 'ev' and returns its events. never uses a chip8aot module */
+CHIP8_API int chip8_run_until(chip8_t *c, int cycles, chip8_event_t *ev);
+
+/* key 0-F pressed (1) or released (0) */
+CHIP8_API void chip8_set_key(chip8_t *c, int key, int pressed);
+
+/* 1 while the sound timer is running */
+CHIP8_API int chip8_sound_on(chip8_t *c);
+
+/* copy the screen out, one byte per pixel (1 = lit), row by row */
+CHIP8_API void chip8_framebuffer(chip8_t *c, unsigned char pixels[CHIP8_WIDTH * CHIP8_HEIGHT]);
+
+/* save/restore the whole machine state. the buffer must hold
+ * chip8_snapshot_size() bytes. return 0 on success, -1 on error */
+CHIP8_API size_t chip8_snapshot_size(void);
+CHIP8_API int    chip8_snapshot_save(chip8_t *c, void *buf, size_t size);
+CHIP8_API int    chip8_snapshot_load(chip8_t *c, const void *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCHIP8_H_INCLUDED */
@@ -2,53 +2,358 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #include "Chip8.hpp"
 #include "Display.hpp"
+#include "TermDisplay.hpp"
+#include "Audio.hpp"
+#include "Trace.hpp"
+#include "Profiler.hpp"
+#include "Debugger.hpp"
+#include "Stats.hpp"
+#include "Timing.hpp"
+#include "Capture.hpp"
+#include "Netplay.hpp"
+#include "RomWatcher.hpp"
+#include "FramePacer.hpp"
+#include "RunAhead.hpp"
+#include "ClockTuner.hpp"
+#include "AntiFlicker.hpp"
 
 // Stupid SDL issue
 #ifdef __WIN32
 #undef main
 #endif
 
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] [ROM file]\n", prog);
+    printf("  --wav FILE    write the sound to a .wav file\n");
+    printf("  --mute        no sound\n");
+    printf("  --term        draw in the terminal instead of a window\n");
+    printf("                (no SDL sound either, --wav still works;\n");
+    printf("                --debug-port instead of --debug)\n");
+    printf("  --term-hold N frames a key stays down after the terminal\n");
+    printf("                last sent it (default %d)\n", TERM_KEY_FRAMES);
+    printf("  --window WxH  window size (default 640x320), resizable\n");
+    printf("  --stretch     fill the window even if pixels end up\n");
+    printf("                different sizes\n");
+    printf("  --palette P   classic, green, amber, lcd or RRGGBB,RRGGBB\n");
+    printf("                (unlit, lit)\n");
+    printf("  --effect E    none, scanlines or grid\n");
+    printf("  --quirks NAME quirk profile: legacy, vip or schip\n");
+    printf("  --clock N     instructions per second (default: the ROM's\n");
+    printf("                calibrated rate, or %d)\n", CLOCK_DEFAULT);
+    printf("  --calibrate   try the ROM at a range of clock rates without\n");
+    printf("                showing it, and remember the best one\n");
+    printf("  --clock-profiles FILE\n");
+    printf("                where calibrated rates are kept (default\n");
+    printf("                ~/.chip8-clocks)\n");
+    printf("  --trace FILE  record every instruction to FILE\n");
+    printf("  --trace-ring FILE\n");
+    printf("                keep the latest instructions in memory and\n");
+    printf("                write them to FILE on exit\n");
+    printf("                (read both with tracedump)\n");
+    printf("  --aot MODULE  run the ROM compiled by chip8aot where it can\n");
+    printf("                (the sound then starts and stops on frame\n");
+    printf("                boundaries)\n");
+    printf("  --profile FILE\n");
+    printf("                count instructions per guest call stack, write\n");
+    printf("                them to FILE on exit as folded stacks (for\n");
+    printf("                flamegraph.pl) and list subroutines on stderr\n");
+    printf("  --debug       debugger commands on stdin ('h' for help)\n");
+    printf("  --debug-port N\n");
+    printf("                debugger commands from 127.0.0.1:N\n");
+    printf("  --no-stats    don't publish live statistics for chip8top\n");
+    printf("  --record FILE record the screen to a .gif or .y4m video\n");
+    printf("  --record-scale N\n");
+    printf("                video pixels per screen pixel (default 4)\n");
+    printf("  --flicker MODE\n");
+    printf("                blend each frame with the ones before it so\n");
+    printf("                sprites drawn every other frame don't flicker:\n");
+    printf("                or (keep pixels lit) or fade (show them in the\n");
+    printf("                palette's third color; or in the terminal)\n");
+    printf("  --flicker-frames N\n");
+    printf("                frames blended (default 3, up to %d)\n", FLICKER_MAX_FRAMES);
+    printf("  --settle      don't show frames that end just after the game\n");
+    printf("                erased something (not with netplay, the\n");
+    printf("                debugger, --aot or --run-ahead)\n");
+    printf("  --run-ahead N show the screen from N frames later (up to %d),\n", RUNAHEAD_MAX);
+    printf("                worked out again every frame, so keys show\n");
+    printf("                up N frames sooner\n");
+    printf("  --net-port N  netplay: receive on UDP port N\n");
+    printf("  --net-peer HOST:PORT\n");
+    printf("                netplay: the other player's --net-port\n");
+    printf("  --watch       patch the ROM into the running game when the\n");
+    printf("                file changes (F5 resets and loads it again)\n");
+}
+
+// start or stop the beep if the sound timer changed
+static void updateTone(Audio &audio, Chip8 &chip, bool &soundOn,
+    uint64_t sample)
+{
+    if(chip.SoundOn() != soundOn)
+    {
+        soundOn = !soundOn;
+        audio.setTone(soundOn, sample);
+    }
+}
+
 int main(int argc, char **argv)
 {
     Chip8 chip;
 
+    const char *romFile = NULL;
+    const char *wavFile = NULL;
+    const char *quirks = NULL;
+    const char *traceFile = NULL;
+    const char *traceRing = NULL;
+    const char *profileFile = NULL;
+    const char *aotFile = NULL;
+    bool debug = false;
+    int debugPort = 0;
+    bool publishStats = true;
+    bool mute = false;
+    bool useTerm = false;
+    int termHold = TERM_KEY_FRAMES;
+    int winWidth = 640, winHeight = 320;
+    bool stretch = false;
+    const char *palette = NULL;
+    ScalerEffect effect = SCALER_NONE;
+    const char *recordFile = NULL;
+    int recordScale = 4;
+    int netPort = 0;
+    const char *netPeer = NULL;
+    bool watch = false;
+    int runAheadFrames = 0;
+    FlickerMode flicker = FLICKER_NONE;
+    int flickerFrames = 3;
+    bool settle = false;
+    int clock = 0;
+    bool calibrate = false;
+    std::string clockProfiles = ClockProfiles::DefaultPath();
+
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "--wav") == 0 && i+1 < argc) wavFile = argv[++i];
+        else if(strcmp(argv[i], "--mute") == 0)         mute = true;
+        else if(strcmp(argv[i], "--term") == 0)         useTerm = true;
+        else if(strcmp(argv[i], "--term-hold") == 0 && i+1 < argc) termHold = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--window") == 0 && i+1 < argc &&
+            sscanf(argv[i+1], "%dx%d", &winWidth, &winHeight) == 2) i++;
+        else if(strcmp(argv[i], "--stretch") == 0)      stretch = true;
+        else if(strcmp(argv[i], "--palette") == 0 && i+1 < argc) palette = argv[++i];
+        else if(strcmp(argv[i], "--effect") == 0 && i+1 < argc)
+        {
+            const char *name = argv[++i];
+            if(strcmp(name, "scanlines") == 0) effect = SCALER_SCANLINES;
+            else if(strcmp(name, "grid") == 0) effect = SCALER_GRID;
+            else if(strcmp(name, "none") != 0) {
+                usage(argv[0]);
+                return 0;
+            }
+        }
+        else if(strcmp(argv[i], "--quirks") == 0 && i+1 < argc) quirks = argv[++i];
+        else if(strcmp(argv[i], "--clock") == 0 && i+1 < argc)  clock = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--calibrate") == 0)    calibrate = true;
+        else if(strcmp(argv[i], "--clock-profiles") == 0 && i+1 < argc) clockProfiles = argv[++i];
+        else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc)  traceFile = argv[++i];
+        else if(strcmp(argv[i], "--trace-ring") == 0 && i+1 < argc) traceRing = argv[++i];
+        else if(strcmp(argv[i], "--profile") == 0 && i+1 < argc) profileFile = argv[++i];
+        else if(strcmp(argv[i], "--aot") == 0 && i+1 < argc) aotFile = argv[++i];
+        else if(strcmp(argv[i], "--debug") == 0)        debug = true;
+        else if(strcmp(argv[i], "--debug-port") == 0 && i+1 < argc) debugPort = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--no-stats") == 0)     publishStats = false;
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc) recordFile = argv[++i];
+        else if(strcmp(argv[i], "--record-scale") == 0 && i+1 < argc) recordScale = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--net-port") == 0 && i+1 < argc) netPort = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--net-peer") == 0 && i+1 < argc) netPeer = argv[++i];
+        else if(strcmp(argv[i], "--watch") == 0)        watch = true;
+        else if(strcmp(argv[i], "--flicker") == 0 && i+1 < argc)
+        {
+            const char *name = argv[++i];
+            if(strcmp(name, "or") == 0)        flicker = FLICKER_OR;
+            else if(strcmp(name, "fade") == 0) flicker = FLICKER_FADE;
+            else if(strcmp(name, "none") != 0) {
+                usage(argv[0]);
+                return 0;
+            }
+        }
+        else if(strcmp(argv[i], "--flicker-frames") == 0 && i+1 < argc) flickerFrames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--settle") == 0)       settle = true;
+        else if(strcmp(argv[i], "--run-ahead") == 0 && i+1 < argc) runAheadFrames = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && !romFile)          romFile = argv[i];
+        else {
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
     // make sure ROM filename was given
-    if(argc != 2) {
-        printf("Usage: %s [ROM file]\n", argv[0]);
+    if(!romFile) {
+        usage(argv[0]);
+        return 0;
+    }
+    if(!netPort != !netPeer || (netPort && (debug || debugPort))) {
+        fprintf(stderr, "Netplay needs both --net-port and --net-peer, and no debugger\n");
+        return 0;
+    }
+    if(netPort && runAheadFrames) {
+        fprintf(stderr, "Netplay already runs ahead, --run-ahead can't be used with it\n");
         return 0;
     }
+    // settling needs every screen change from Chip8::Run(), these run
+    // frames some other way
+    if(settle && (netPort || debug || debugPort || aotFile || runAheadFrames)) {
+        fprintf(stderr, "--settle can't be used with netplay, the debugger, --aot or --run-ahead\n");
+        return 0;
+    }
+    // both read stdin; --debug-port leaves it to the terminal
+    if(useTerm && debug) {
+        fprintf(stderr, "--term reads keys from stdin, use --debug-port with it\n");
+        return 0;
+    }
+    if(clock && clock < 60) {
+        fprintf(stderr, "--clock needs at least 60 instructions per second\n");
+        return 0;
+    }
+
+    // the ROM's rate, from the last --calibrate unless given
+    ClockProfiles profiles;
+    profiles.Load(clockProfiles.c_str());
+    if(calibrate)
+    {
+        ClockTuner tuner;
+        if(!tuner.Open(romFile, quirks)) return -1;
+
+        int best = tuner.Calibrate();
+        profiles.Set(tuner.Hash(), best, romFile);
+        if(!profiles.Save()) return -1;
+        printf("Saved to %s\n", clockProfiles.c_str());
+        return 0;
+    }
+    // the peers' profiles may differ, so netplay needs --clock on both
+    if(!clock && !netPort) clock = profiles.FindFile(romFile);
+    if(clock) fprintf(stderr, "Clock: %d instructions per second\n", clock);
+    else      clock = CLOCK_DEFAULT;
     
-    Display display(640, 320, "Chip8 Emulator");
+    // made before the terminal below, so the timing histogram and the
+    // profile get printed after it's restored
+    FramePacer pacer;
+    Profiler profiler;
+    RunAhead runAhead;
+    runAhead.SetFrames(runAheadFrames);
+
+    // the terminal has no third color to fade to
+    AntiFlicker antiFlicker;
+    antiFlicker.SetMode(useTerm && flicker == FLICKER_FADE ? FLICKER_OR :
+        flicker, flickerFrames);
+    antiFlicker.SetSettle(settle);
+
+    // the window, or the terminal
+    Display *display = NULL;
+    TermDisplay term;
+    term.setKeyHold(termHold);
+    if(useTerm) term.open();
+    else
+    {
+        display = new Display(winWidth, winHeight, "Chip8 Emulator");
+        display->setStretch(stretch);
+        display->scaler().SetEffect(effect);
+        if(palette && !display->scaler().SetPalette(palette)) {
+            fprintf(stderr, "Unknown palette '%s'\n", palette);
+            return -1;
+        }
+    }
+
+    Audio audio;
+    bool audioOpen = false;
+    if(wavFile)     audioOpen = audio.openWAV(wavFile);
+    else if(!mute && !useTerm) audioOpen = audio.openSDL();
 
     // reset the CPU
     chip.CPUReset();
 
     // load the ROM
-    if(!chip.LoadROM(argv[1])) {
+    if(!chip.LoadROM(romFile)) {
         return -1;
     }
 
+    // override the profile picked for the ROM
+    if(quirks && !chip.SetQuirks(quirks)) {
+        fprintf(stderr, "Unknown quirk profile '%s'\n", quirks);
+        return -1;
+    }
+    if(aotFile && !chip.LoadAot(aotFile)) return -1;
+
+    Tracer tracer;
+    if(traceFile) {
+        if(!tracer.OpenFile(traceFile)) return -1;
+        chip.AttachTracer(&tracer);
+    }
+    else if(traceRing) {
+        tracer.DumpOnClose(traceRing);
+        chip.AttachTracer(&tracer);
+    }
+
+    if(profileFile) {
+        profiler.WriteOnClose(profileFile);
+        chip.AttachProfiler(&profiler);
+    }
+
+    // only used if asked for, the normal loop below stays as is
+    Debugger debugger(chip);
+    if(debugPort) {
+        if(!debugger.Listen(debugPort)) return -1;
+        debug = true;
+    }
+    else if(debug) {
+        debugger.OpenStdin();
+    }
+
+    StatsPublisher stats;
+    if(publishStats) stats.Open(romFile);
+
+    VideoRecorder recorder;
+    if(recordFile && !recorder.Open(recordFile, recordScale)) return -1;
+
     // fps of the game to run at
     // the timers run at 60hz so 60fps is perfect
     int fps = 60;
     
-    // found in chip8 src ini
-    int opsPerSec = 400;
+    // found in chip8 src ini, unless the ROM has a calibrated rate
+    int opsPerSec = clock;
     
     // number of opcodes to execute per frame
     int numframe = opsPerSec / fps;
+
+    // the timers tick once a frame's worth of instructions
+    chip.SetCyclesPerTick(numframe);
+
+    // opened with the clock set, so peers with different clocks don't
+    // get the same session
+    Netplay netplay;
+    if(netPort && !netplay.Open(netPort, netPeer, chip)) return -1;
+    WORD localKeys = 0;
+
+    // both peers must run the same code, so no reloading with netplay
+    RomWatcher watcher;
+    if(watch && !netplay.IsOpen() && !watcher.Open(romFile)) return -1;
     
-    // how long to delay
-    float interval = 1000.0f / fps;
-    
-    unsigned int time2 = SDL_GetTicks();
+    // frames are due every 1/fps seconds from now
+    pacer.Start(1000000000ULL / fps);
+
+    // position on the audio timeline, counted in emulated frames so
+    // the tone starts and stops at the exact instruction
+    unsigned long long frames = 0;
+    bool soundOn = false;
 
-    // inf loop
-    for(;;)
+    // until Esc, closing the window, 'q' in the debugger or an error
+    int status = EXIT_SUCCESS;
+    for(bool running = true; running; )
     {
         
         //chip.RunNextInstruction(display);
@@ -56,26 +361,133 @@ int main(int argc, char **argv)
         //display.update(chip.m_ScreenData);
         //getchar();
         
-        unsigned int current = SDL_GetTicks();
-        
-        if( (time2 + interval) < current )
+        // sleeps until the frame is due
+        bool dropped = pacer.Wait();
+        uint64_t workStart = NowNanos();
+
+        // netplay runs the timers itself, it may replay frames
+        if(display) running = display->pollEvents(localKeys);
+        else        running = term.pollEvents(localKeys);
+        if(!running) break;
+
+        // netplay sets the keys itself, it may replay frames
+        if(!netplay.IsOpen())
+        {
+            for(int k=0; k<16; k++)
+                chip.SetKey(k, (localKeys >> k) & 1);
+        }
+
+        // the screen is only drawn when something changed it
+        bool redraw = frames == 0;
+
+        // F5: start over with the ROM as it is on disk now
+        bool reset = display ? display->takeReset() : term.takeReset();
+        if(reset && !netplay.IsOpen())
         {
-            display.pollEvents(chip);
-            
-            // TODO - add sound timer
-            chip.DecreaseTimers();
-            
-            // execute our calculated number of ops
-            for(int i=0; i<numframe; i++)
-                chip.RunNextInstruction();
-                
-            // get the new time
-            time2 = current;
-            
-            // get keys and refresh the screen
-            display.update(chip.m_ScreenData);
+            chip.CPUReset();
+            if(!chip.LoadROM(romFile)) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if(quirks) chip.SetQuirks(quirks);
+            chip.SetCyclesPerTick(numframe);
+            watcher.Reloaded();
+            redraw = true;
         }
+        else watcher.Poll(chip);
+
+        uint64_t frameStart = frames * audio.sampleRate() / fps;
+        uint64_t frameEnd   = (frames+1) * audio.sampleRate() / fps;
+
+        if(audioOpen) updateTone(audio, chip, soundOn, frameStart);
+
+        if(netplay.IsOpen())
+        {
+            // a stalled frame just shows the same picture again
+            if(netplay.RunFrame(chip, localKeys, numframe) < 0) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if(audioOpen) updateTone(audio, chip, soundOn, frameStart);
+            redraw = true;
+        }
+        else if(debug)
+        {
+            // breakpoints and stepping; sound is only updated
+            // once per frame here
+            if(!debugger.Run(numframe)) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if(debugger.QuitRequested()) break;
+            if(audioOpen) updateTone(audio, chip, soundOn, frameStart);
+            redraw = true;
+        }
+        // the whole frame at once, through the compiled blocks; the
+        // tone can only change between frames here
+        else if(aotFile)
+        {
+            if(!chip.RunCycles(numframe)) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if(audioOpen) updateTone(audio, chip, soundOn, frameStart);
+            redraw = true;
+        }
+        // execute our calculated number of ops, stopping only when
+        // the screen or the beep changes
+        else for(int done=0; done<numframe; )
+        {
+            Chip8Event ev = chip.Run(numframe - done);
+            done += ev.cycles;
+
+            if(ev.events & CHIP8_EVENT_BADOP) {
+                status = EXIT_FAILURE;
+                running = false;
+                break;
+            }
+            if(ev.events & CHIP8_EVENT_SCREEN)
+            {
+                redraw = true;
+                antiFlicker.Drawn(chip, ev.pc);
+            }
+
+            // timestamp sound timer writes with the instruction
+            // that made them
+            if((ev.events & CHIP8_EVENT_SOUND) && audioOpen)
+                updateTone(audio, chip, soundOn,
+                    frameStart + (frameEnd - frameStart) * done / numframe);
+        }
+        if(!running) break;
+
+        if(audioOpen) audio.sync(frameEnd);
+        frames++;
+
+        // the screen a few frames on can change without this one
+        if(runAhead.Frames() || (display && display->takeRedraw()))
+            redraw = true;
+
+        // what the screen will look like a few frames on, with the
+        // keys as they are now
+        const uint64_t *screen = chip.m_Screen, *plane1 = NULL;
+        if(redraw) screen = runAhead.Run(chip, numframe, 1000000000ULL / fps);
+
+        // blended with the frames before, which change it even when
+        // the game didn't
+        if(antiFlicker.Enabled() &&
+            antiFlicker.Present(screen, &screen, &plane1)) redraw = true;
+
+        // refresh the screen
+        if(redraw)
+        {
+            if(display) display->update(screen, plane1);
+            else        term.update(screen);
+        }
+        recorder.AddFrame(chip, false);
+
+        stats.FrameDone(workStart, NowNanos() - workStart, numframe,
+            chip.m_PC, dropped);
     }
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,431 @@
+/* Runs a corpus of ROMs headless and compares their state at
+ * checkpoints against stored golden hashes */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "Chip8.hpp"
+#include "Capture.hpp"
+
+// manifest lines (# starts a comment):
+//   ROM FRAMES [name=NAME] [ops=N] [quirks=NAME] [seed=N] [check=F,F,...]
+//       [keys=F:K+,F:K-,...]
+// name is what the golden hashes and images go under (default the ROM,
+// so a ROM listed twice needs one), ops is instructions per frame
+// (default 400/60 like main.cpp), check lists the frames to hash
+// (default every 60 frames and the last), keys presses (+) or releases
+// (-) hex key K at the start of frame F
+//
+// golden file lines:
+//   NAME FRAME HASH
+
+struct KeyEvent
+{
+    int frame;
+    int key;
+    int val;
+};
+
+struct Test
+{
+    std::string name;
+    std::string rom;
+    int frames;
+    int ops;
+    std::string quirks;
+    unsigned int seed;
+    std::vector<int> checks;
+    std::vector<KeyEvent> keys;
+
+    // results
+    std::vector<uint64_t> hashes; // one per check
+    std::vector<uint64_t> screens; // screen rows at each check, 32 each
+    int crashFrame;               // -1 if it ran to the end
+    std::string error;
+};
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] MANIFEST\n", prog);
+    printf("  --golden FILE  golden hashes (default MANIFEST.golden)\n");
+    printf("  --update       write the golden file from this run, unless a\n");
+    printf("                 test fails (crashes or can't run)\n");
+    printf("  --out DIR      where mismatch images go (default regress-out)\n");
+    printf("  -j N           ROMs to run at once (default: all cores)\n");
+    printf("  --record DIR   save a .gif of every ROM's run in DIR\n");
+    printf("  --aot DIR      run ROMs through DIR/ROM.so (from chip8aot)\n");
+    printf("                 where there is one; the hashes must not change\n");
+}
+
+/* FNV-1a */
+static uint64_t hashBytes(uint64_t h, const void *data, size_t len)
+{
+    const BYTE *p = (const BYTE*)data;
+    for(size_t i=0; i<len; i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/* hash everything a game can observe */
+static uint64_t hashState(Chip8 &chip, uint64_t rows[32])
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    h = hashBytes(h, rows, sizeof(uint64_t) * 32);
+    h = hashBytes(h, chip.m_Registers, sizeof(chip.m_Registers));
+    h = hashBytes(h, &chip.m_AddressI, sizeof(chip.m_AddressI));
+    h = hashBytes(h, &chip.m_PC, sizeof(chip.m_PC));
+    h = hashBytes(h, chip.m_Stack.data(), sizeof(WORD) * chip.m_Stack.size());
+    BYTE delay = chip.DelayTimer(), sound = chip.SoundTimer();
+    h = hashBytes(h, &delay, sizeof(delay));
+    h = hashBytes(h, &sound, sizeof(sound));
+    return h;
+}
+
+/* what a test's files are called: the last part of its name */
+static std::string fileName(const Test &t)
+{
+    size_t slash = t.name.rfind('/');
+    return slash == std::string::npos ? t.name : t.name.substr(slash + 1);
+}
+
+/* read one manifest line */
+static bool parseTest(char *line, Test &t)
+{
+    char rom[512];
+    int frames;
+    int used;
+    if(sscanf(line, "%511s %d%n", rom, &frames, &used) != 2) return false;
+
+    t.name = rom;
+    t.rom = rom;
+    t.frames = frames;
+    t.ops = 400 / 60;
+    t.seed = 1;
+    t.crashFrame = -1;
+
+    char *tok = strtok(line + used, " \t\r\n");
+    for(; tok; tok = strtok(NULL, " \t\r\n"))
+    {
+        if(strncmp(tok, "name=", 5) == 0 && tok[5]) t.name = tok + 5;
+        else if(strncmp(tok, "ops=", 4) == 0)    t.ops = atoi(tok + 4);
+        else if(strncmp(tok, "quirks=", 7) == 0) t.quirks = tok + 7;
+        else if(strncmp(tok, "seed=", 5) == 0)   t.seed = strtoul(tok + 5, NULL, 0);
+        else if(strncmp(tok, "check=", 6) == 0)
+        {
+            for(char *p = tok + 6; *p; )
+            {
+                t.checks.push_back(strtol(p, &p, 10));
+                if(*p == ',') p++;
+                else if(*p) return false;
+            }
+        }
+        else if(strncmp(tok, "keys=", 5) == 0)
+        {
+            for(char *p = tok + 5; *p; )
+            {
+                KeyEvent k;
+                k.frame = strtol(p, &p, 10);
+                if(*p++ != ':') return false;
+                k.key = strtol(p, &p, 16) & 0xF;
+                if(*p != '+' && *p != '-') return false;
+                k.val = (*p++ == '+');
+                t.keys.push_back(k);
+                if(*p == ',') p++;
+            }
+        }
+        else return false;
+    }
+
+    if(t.checks.empty())
+    {
+        for(int f=60; f<frames; f+=60) t.checks.push_back(f);
+        t.checks.push_back(frames);
+    }
+
+    // checkpoints are hashed in frame order as the ROM runs
+    std::sort(t.checks.begin(), t.checks.end());
+    t.checks.erase(std::unique(t.checks.begin(), t.checks.end()), t.checks.end());
+    if(t.checks.front() < 0 || t.checks.back() > frames)
+    {
+        fprintf(stderr, "%s: check frames must be 0 to %d\n", rom, frames);
+        return false;
+    }
+    return true;
+}
+
+/* run one ROM and hash it at each checkpoint, recording it to
+ * recordDir/ROM.gif if recordDir isn't empty, and using aotDir/ROM.so
+ * if aotDir isn't empty and it's there */
+static void runTest(Test &t, const std::string &recordDir,
+    const std::string &aotDir)
+{
+    Chip8 *chip = new Chip8;
+    chip->CPUReset();
+    chip->SetSeed(t.seed);
+
+    if(!chip->LoadROM(t.rom.c_str()))
+    {
+        t.error = "can't load ROM";
+        delete chip;
+        return;
+    }
+    if(!t.quirks.empty() && !chip->SetQuirks(t.quirks.c_str()))
+    {
+        t.error = "unknown quirk profile " + t.quirks;
+        delete chip;
+        return;
+    }
+
+    const char *base = strrchr(t.rom.c_str(), '/');
+    base = base ? base+1 : t.rom.c_str();
+
+    struct stat st;
+    std::string module = aotDir + "/" + base + ".so";
+    if(!aotDir.empty() && stat(module.c_str(), &st) == 0 &&
+        !chip->LoadAot(module.c_str()))
+    {
+        t.error = "can't load " + module;
+        delete chip;
+        return;
+    }
+
+    VideoRecorder recorder;
+    if(!recordDir.empty())
+    {
+        recorder.Open((recordDir + "/" + fileName(t) + ".gif").c_str(), 4);
+    }
+
+    // the timers tick once a frame like in main.cpp
+    chip->SetCyclesPerTick(t.ops);
+
+    size_t nextCheck = 0;
+    size_t nextKey = 0;
+    uint64_t rows[32];
+
+    // checkpoint "frame F" is the state after F frames
+    for(int frame=0; frame<=t.frames && nextCheck < t.checks.size(); frame++)
+    {
+        while(nextCheck < t.checks.size() && t.checks[nextCheck] == frame)
+        {
+            chip->GetScreenRows(rows);
+            t.hashes.push_back(hashState(*chip, rows));
+            t.screens.insert(t.screens.end(), rows, rows + 32);
+            nextCheck++;
+        }
+        if(frame == t.frames) break;
+
+        while(nextKey < t.keys.size() && t.keys[nextKey].frame <= frame)
+        {
+            chip->SetKey(t.keys[nextKey].key, t.keys[nextKey].val);
+            nextKey++;
+        }
+
+        if(t.crashFrame < 0 && !chip->RunCycles(t.ops)) t.crashFrame = frame;
+        recorder.AddFrame(*chip, true);
+    }
+
+    recorder.Close();
+
+    delete chip;
+}
+
+/* write a screen as a .pbm image */
+static void writePBM(const char *fname, const uint64_t *rows)
+{
+    FILE *fp = fopen(fname, "wb");
+    if(!fp) return;
+
+    fprintf(fp, "P4\n64 32\n");
+    for(int y=0; y<32; y++)
+        for(int b=7; b>=0; b--)
+            fputc((rows[y] >> (b*8)) & 0xFF, fp);
+    fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    const char *manifest = NULL;
+    std::string golden;
+    std::string outDir = "regress-out";
+    std::string recordDir;
+    std::string aotDir;
+    bool update = false;
+    int jobs = std::thread::hardware_concurrency();
+
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "--golden") == 0 && i+1 < argc) golden = argv[++i];
+        else if(strcmp(argv[i], "--update") == 0)         update = true;
+        else if(strcmp(argv[i], "--out") == 0 && i+1 < argc) outDir = argv[++i];
+        else if(strcmp(argv[i], "-j") == 0 && i+1 < argc) jobs = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc) recordDir = argv[++i];
+        else if(strcmp(argv[i], "--aot") == 0 && i+1 < argc) aotDir = argv[++i];
+        else if(argv[i][0] != '-' && !manifest)          manifest = argv[i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(!manifest) {
+        usage(argv[0]);
+        return 2;
+    }
+    if(golden.empty()) golden = std::string(manifest) + ".golden";
+    if(jobs < 1) jobs = 1;
+    if(!recordDir.empty()) mkdir(recordDir.c_str(), 0755);
+
+    // read the tests
+    std::vector<Test> tests;
+    FILE *fp = fopen(manifest, "r");
+    if(!fp) {
+        fprintf(stderr, "Failed to open '%s'\n", manifest);
+        return 2;
+    }
+    char line[2048];
+    for(int num=1; fgets(line, sizeof(line), fp); num++)
+    {
+        char *p = line + strspn(line, " \t");
+        if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        Test t;
+        if(!parseTest(p, t)) {
+            fprintf(stderr, "%s:%d: bad line\n", manifest, num);
+            return 2;
+        }
+        tests.push_back(t);
+    }
+    fclose(fp);
+
+    // each test needs its own golden hashes and images
+    std::map<std::string, std::string> names;
+    for(size_t i=0; i<tests.size(); i++)
+    {
+        std::string &other = names[fileName(tests[i])];
+        if(!other.empty()) {
+            fprintf(stderr, "%s: '%s' and '%s' would share golden hashes "
+                "and images, give one a name=\n", manifest, other.c_str(),
+                tests[i].name.c_str());
+            return 2;
+        }
+        other = tests[i].name;
+    }
+
+    // read the golden hashes
+    std::map<std::string, uint64_t> expected;
+    fp = update ? NULL : fopen(golden.c_str(), "r");
+    if(fp)
+    {
+        char name[512];
+        int frame;
+        unsigned long long hash;
+        while(fscanf(fp, "%511s %d %llx", name, &frame, &hash) == 3)
+        {
+            snprintf(line, sizeof(line), "%s %d", name, frame);
+            expected[line] = hash;
+        }
+        fclose(fp);
+    }
+
+    // every thread takes the next test until they're all done
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for(int j=0; j<jobs; j++)
+    {
+        workers.push_back(std::thread([&]() {
+            for(size_t i; (i = next++) < tests.size(); )
+                runTest(tests[i], recordDir, aotDir);
+        }));
+    }
+    for(size_t j=0; j<workers.size(); j++) workers[j].join();
+
+    // compare
+    int failed = 0, fresh = 0;
+    for(size_t i=0; i<tests.size(); i++)
+    {
+        Test &t = tests[i];
+        if(!t.error.empty())
+        {
+            printf("FAIL %s: %s\n", t.name.c_str(), t.error.c_str());
+            failed++;
+            continue;
+        }
+
+        bool ok = true, isNew = false;
+        if(t.hashes.size() != t.checks.size())
+        {
+            printf("FAIL %s: only %d of %d checks were reached\n",
+                t.name.c_str(), (int)t.hashes.size(), (int)t.checks.size());
+            ok = false;
+        }
+        // what it hashed after that isn't the game any more
+        if(t.crashFrame >= 0)
+        {
+            printf("FAIL %s: unhandled opcode at frame %d\n", t.name.c_str(),
+                t.crashFrame);
+            ok = false;
+        }
+        for(size_t c=0; c<t.hashes.size() && !update; c++)
+        {
+            snprintf(line, sizeof(line), "%s %d", t.name.c_str(), t.checks[c]);
+            std::map<std::string, uint64_t>::iterator e = expected.find(line);
+            if(e == expected.end()) {
+                isNew = true;
+                continue;
+            }
+            if(e->second == t.hashes[c]) continue;
+
+            // save what the screen looked like
+            mkdir(outDir.c_str(), 0755);
+            snprintf(line, sizeof(line), "%s/%s-%d.pbm", outDir.c_str(),
+                fileName(t).c_str(), t.checks[c]);
+            writePBM(line, &t.screens[c*32]);
+
+            printf("FAIL %s: frame %d hash %016llx, expected %016llx (%s)\n",
+                t.name.c_str(), t.checks[c], (unsigned long long)t.hashes[c],
+                (unsigned long long)e->second, line);
+            ok = false;
+        }
+
+        if(!ok)        failed++;
+        else if(isNew) { fresh++; printf("NEW  %s (no golden hash)\n", t.name.c_str()); }
+    }
+
+    // a failed run would become what the next one is checked against
+    if(update && failed)
+    {
+        printf("%d failed, not writing %s\n", failed, golden.c_str());
+        return 1;
+    }
+    if(update)
+    {
+        FILE *out = fopen(golden.c_str(), "w");
+        if(!out) {
+            fprintf(stderr, "Failed to write '%s'\n", golden.c_str());
+            return 2;
+        }
+        for(size_t i=0; i<tests.size(); i++)
+            for(size_t c=0; c<tests[i].hashes.size(); c++)
+                fprintf(out, "%s %d %016llx\n", tests[i].name.c_str(),
+                    tests[i].checks[c], (unsigned long long)tests[i].hashes[c]);
+        fclose(out);
+        printf("wrote %s for %d tests\n", golden.c_str(), (int)tests.size());
+        return 0;
+    }
+
+    printf("%d passed, %d failed, %d new\n",
+        (int)tests.size() - failed - fresh, failed, fresh);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/* Turns a binary trace (see Trace.hpp) into text, or compares two */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Trace.hpp"
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s TRACE            print every record\n", prog);
+    printf("       %s TRACE1 TRACE2    print where the runs differ, from\n", prog);
+    printf("                             the first instruction both have\n");
+    printf("  --max N    stop after N differences (default 20)\n");
+}
+
+static FILE *openTrace(const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    if(!fp) {
+        fprintf(stderr, "Failed to open '%s'\n", fname);
+        return NULL;
+    }
+    if(!Tracer::ReadHeader(fp)) {
+        fprintf(stderr, "'%s' is not a trace file\n", fname);
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+static void printRecord(const char *prefix, const TraceRecord &r)
+{
+    printf("%s%10llu  PC=%03X  %04X  I=%03X", prefix,
+        (unsigned long long)r.count, r.pc, r.opcode, r.i);
+    if(r.reg != TRACE_NO_REG) printf("  V%X=%02X", r.reg, r.value);
+    printf("\n");
+}
+
+static bool sameRecord(const TraceRecord &a, const TraceRecord &b)
+{
+    return a.pc == b.pc && a.opcode == b.opcode && a.i == b.i &&
+           a.reg == b.reg && (a.reg == TRACE_NO_REG || a.value == b.value);
+}
+
+/* print the whole trace */
+static int dump(FILE *fp)
+{
+    TraceRecord r;
+    while(fread(&r, sizeof(r), 1, fp) == 1)
+        printRecord("", r);
+    return 0;
+}
+
+/* print the first differences between two traces */
+static int diff(FILE *a, FILE *b, int maxDiffs)
+{
+    const int CONTEXT = 5;
+    TraceRecord history[CONTEXT];
+    int historyLen = 0;
+
+    int diffs = 0;
+    unsigned long long total = 0;
+    TraceRecord ra, rb;
+    bool gotA = fread(&ra, sizeof(ra), 1, a) == 1;
+    bool gotB = fread(&rb, sizeof(rb), 1, b) == 1;
+
+    // a ring dump starts wherever the ring had got to, so skip ahead to
+    // the first instruction both traces have
+    unsigned long long skipA = 0, skipB = 0;
+    while(gotA && gotB && ra.count != rb.count)
+    {
+        if(ra.count < rb.count) {
+            gotA = fread(&ra, sizeof(ra), 1, a) == 1;
+            skipA++;
+        }
+        else {
+            gotB = fread(&rb, sizeof(rb), 1, b) == 1;
+            skipB++;
+        }
+    }
+    if(skipA || skipB)
+    {
+        if(!gotA || !gotB) {
+            printf("traces have no instruction in common\n");
+            return 1;
+        }
+        printf("lined up at instruction %llu (skipped %llu records of the "
+            "1st, %llu of the 2nd)\n", (unsigned long long)ra.count,
+            skipA, skipB);
+    }
+
+    for(;; gotA = fread(&ra, sizeof(ra), 1, a) == 1,
+           gotB = fread(&rb, sizeof(rb), 1, b) == 1)
+    {
+        if(!gotA || !gotB)
+        {
+            if(gotA != gotB)
+                printf("%s ends after %llu records\n", gotA ? "2nd" : "1st",
+                    total);
+            break;
+        }
+        total++;
+
+        if(sameRecord(ra, rb))
+        {
+            if(diffs == 0)
+            {
+                // keep some context to show before the first difference
+                if(historyLen == CONTEXT) {
+                    memmove(history, history+1, sizeof(TraceRecord)*(CONTEXT-1));
+                    historyLen--;
+                }
+                history[historyLen++] = ra;
+            }
+            continue;
+        }
+
+        if(diffs == 0)
+        {
+            for(int i=0; i<historyLen; i++) printRecord("  ", history[i]);
+        }
+        if(diffs < maxDiffs)
+        {
+            printRecord("< ", ra);
+            printRecord("> ", rb);
+        }
+        diffs++;
+    }
+
+    if(diffs == 0) printf("traces match (%llu records)\n", total);
+    else           printf("%d of %llu records differ\n", diffs, total);
+
+    return diffs == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *files[2];
+    int numFiles = 0;
+    int maxDiffs = 20;
+
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "--max") == 0 && i+1 < argc) maxDiffs = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && numFiles < 2)       files[numFiles++] = argv[i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(numFiles == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE *a = openTrace(files[0]);
+    if(!a) return 2;
+
+    if(numFiles == 1) return dump(a);
+
+    FILE *b = openTrace(files[1]);
+    if(!b) return 2;
+
+    return diff(a, b, maxDiffs);
+}